@@ -109,6 +109,7 @@ public:
     size_t keySize() const;
 
     bool setKey(const uint8_t *key, size_t len);
+    bool setSchedule(const uint8_t *schedule, size_t len);
 
 private:
     uint8_t sched[240];
@@ -106,6 +106,25 @@ bool AES256::setKey(const uint8_t *key, size_t len)
     return true;
 }
 
+/**
+ * \brief Sets an already expanded key schedule.
+ *
+ * \param schedule The 240 bytes of round keys, in the layout produced
+ * by setKey().
+ * \param len The length of the schedule, which must be 240.
+ * \return Returns false if \a len is not 240.
+ *
+ * This skips the key expansion for keys that are expanded ahead of time,
+ * for example at compile time.
+ */
+bool AES256::setSchedule(const uint8_t *schedule, size_t len)
+{
+    if (len != sizeof(sched))
+        return false;
+    memcpy(sched, schedule, len);
+    return true;
+}
+
 /**
  * \class AESTiny256 AES.h <AES.h>
  * \brief AES block cipher with 256-bit keys and tiny memory usage.
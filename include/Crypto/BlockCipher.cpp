@@ -112,6 +112,33 @@ BlockCipher::~BlockCipher()
  * \sa encryptBlock(), blockSize()
  */
 
+/**
+ * \brief Encrypts several consecutive blocks using this cipher.
+ *
+ * \param output The output buffer to put the ciphertext into.
+ * Must be at least \a count * blockSize() bytes in length.
+ * \param input The input buffer to read the plaintext from which is
+ * allowed to overlap with \a output.  Must be at least
+ * \a count * blockSize() bytes in length.
+ * \param count The number of blocks to encrypt.
+ *
+ * The default implementation calls encryptBlock() for every block.
+ * Ciphers that process several blocks at once, such as bitsliced
+ * implementations, can override this to encrypt them together.
+ *
+ * \sa encryptBlock(), blockSize()
+ */
+void BlockCipher::encryptBlocks(uint8_t *output, const uint8_t *input, size_t count)
+{
+    size_t size = blockSize();
+    while (count > 0) {
+        encryptBlock(output, input);
+        output += size;
+        input += size;
+        --count;
+    }
+}
+
 /**
  * \fn void BlockCipher::clear()
  * \brief Clears all security-sensitive state from this block cipher.
@@ -24,6 +24,13 @@
 #include "Crypto.h"
 #include <string.h>
 
+#if CTR_KEYSTREAM_BLOCKS < 2 || CTR_KEYSTREAM_BLOCKS > 15
+#error "CTR_KEYSTREAM_BLOCKS must be between 2 and 15"
+#endif
+
+// Word access to byte buffers that are known to be aligned.
+typedef uint32_t __attribute__((__may_alias__)) ctr_word_t;
+
 /**
  * \class CTRCommon CTR.h <CTR.h>
  * \brief Concrete base class to assist with implementing CTR mode for
@@ -41,7 +48,8 @@
  */
 CTRCommon::CTRCommon()
     : blockCipher(0)
-    , posn(16)
+    , stateSize(0)
+    , posn(sizeof(state))
     , counterStart(0)
 {
 }
@@ -121,35 +129,32 @@ bool CTRCommon::setIV(const uint8_t *iv, size_t len)
     if (len != 16)
         return false;
     memcpy(counter, iv, len);
-    posn = 16;
+    posn = sizeof(state);
     return true;
 }
 
 void CTRCommon::encrypt(uint8_t *output, const uint8_t *input, size_t len)
 {
     while (len > 0) {
-        if (posn >= 16) {
-            // Generate a new encrypted counter block.
-            blockCipher->encryptBlock(state, counter);
-            posn = 0;
-
-            // Increment the counter, taking care not to reveal
-            // any timing information about the starting value.
-            // We iterate through the entire counter region even
-            // if we could stop earlier because a byte is non-zero.
-            uint16_t temp = 1;
-            uint8_t index = 16;
-            while (index > counterStart) {
-                --index;
-                temp += counter[index];
-                counter[index] = (uint8_t)temp;
-                temp >>= 8;
-            }
-        }
-        uint8_t templen = 16 - posn;
+        if (posn >= stateSize)
+            generateKeystream(len);
+        size_t templen = stateSize - posn;
         if (templen > len)
             templen = len;
         len -= templen;
+
+        // XOR a word at a time when the input, output and keystream
+        // are all aligned, which is the usual case for whole buffers.
+        if ((((uintptr_t)output | (uintptr_t)input | posn) & 3) == 0) {
+            while (templen >= 4) {
+                *((ctr_word_t *)output) = *((const ctr_word_t *)input) ^
+                                          *((const ctr_word_t *)(state + posn));
+                output += 4;
+                input += 4;
+                posn += 4;
+                templen -= 4;
+            }
+        }
         while (templen > 0) {
             *output++ = *input++ ^ state[posn++];
             --templen;
@@ -167,7 +172,45 @@ void CTRCommon::clear()
     blockCipher->clear();
     clean(counter);
     clean(state);
-    posn = 16;
+    posn = sizeof(state);
+}
+
+/**
+ * \brief Generates the keystream for the next \a len bytes, up to
+ * CTR_KEYSTREAM_BLOCKS blocks at a time.
+ *
+ * The counter blocks are written to the state and encrypted in place with
+ * a single call so that ciphers which process several blocks at once
+ * can encrypt them together.
+ */
+void CTRCommon::generateKeystream(size_t len)
+{
+    size_t count = (len + 15) / 16;
+    if (count > CTR_KEYSTREAM_BLOCKS)
+        count = CTR_KEYSTREAM_BLOCKS;
+    for (size_t index = 0; index < count; ++index) {
+        memcpy(state + index * 16, counter, 16);
+        incrementCounter();
+    }
+    blockCipher->encryptBlocks(state, state, count);
+    stateSize = count * 16;
+    posn = 0;
+}
+
+void CTRCommon::incrementCounter()
+{
+    // Increment the counter, taking care not to reveal
+    // any timing information about the starting value.
+    // We iterate through the entire counter region even
+    // if we could stop earlier because a byte is non-zero.
+    uint16_t temp = 1;
+    uint8_t index = 16;
+    while (index > counterStart) {
+        --index;
+        temp += counter[index];
+        counter[index] = (uint8_t)temp;
+        temp >>= 8;
+    }
 }
 
 /**
@@ -26,6 +26,11 @@
 #include "Cipher.h"
 #include "BlockCipher.h"
 
+// Number of keystream blocks that are generated at once, at least 2.
+#ifndef CTR_KEYSTREAM_BLOCKS
+#define CTR_KEYSTREAM_BLOCKS 4
+#endif
+
 class CTRCommon : public Cipher
 {
 public:
@@ -42,6 +47,9 @@ public:
     void encrypt(uint8_t *output, const uint8_t *input, size_t len);
     void decrypt(uint8_t *output, const uint8_t *input, size_t len);
 
+    void encrypt(uint8_t *data, size_t len) { encrypt(data, data, len); }
+    void decrypt(uint8_t *data, size_t len) { encrypt(data, data, len); }
+
     void clear();
 
 protected:
@@ -51,9 +59,13 @@ protected:
 private:
     BlockCipher *blockCipher;
     uint8_t counter[16];
-    uint8_t state[16];
+    alignas(4) uint8_t state[CTR_KEYSTREAM_BLOCKS * 16];
+    uint8_t stateSize;
     uint8_t posn;
     uint8_t counterStart;
+
+    void generateKeystream(size_t len);
+    void incrementCounter();
 };
 
 template <typename T>
@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <climits>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "./config.h"
+#include "./clock.cpp"
+
+#ifndef __AES_CTR_CPP__
+#define __AES_CTR_CPP__
+
+#include "Crypto/BlockCipher.cpp"
+#include "Crypto/AESCommon.cpp"
+#include "Crypto/Crypto.cpp"
+#include "Crypto/AES256.cpp"
+#include "Crypto/Cipher.cpp"
+#include "Crypto/CTR.cpp"
+#include "./aes-key.cpp"
+#include "./aes-fast.cpp"
+#include "./aes-sliced.cpp"
+
+#include "cpp-base64/base64.cpp"
+
+/* #region Encryption */
+
+void random_fill(u_int8_t *buffer, const size_t &size) {
+  static std::default_random_engine randomEngine(clock_epoch_us() / 1000);
+  static std::uniform_int_distribution<u_int8_t> uniformDist(CHAR_MIN, CHAR_MAX);
+
+  for (size_t i = 0; i < size; i++) {
+    buffer[i] = uniformDist(randomEngine);
+  }
+}
+
+#ifdef AES_ENCRYPTION_KEY
+
+/**
+ * AES-256 in CTR mode keyed with the schedule expanded at compile time,
+ * AES_CONSTANT_TIME selects the bitsliced cipher instead of the tables
+ */
+class AesCtr : public CTRCommon {
+  private:
+#ifdef AES_CONSTANT_TIME
+    AesSliced256 cipher;
+#else
+    AesFast256 cipher;
+#endif
+
+  public:
+    AesCtr() {
+      this->setBlockCipher(&this->cipher);
+      this->cipher.setSchedule(aes_key_schedule.data(), aes_key_schedule.size());
+      this->setCounterSize(4);
+    }
+};
+
+/**
+ * The cipher context shared by the messages that are encrypted or decrypted
+ * in one call, every message only sets its IV.
+ */
+static AesCtr* aes_ctr_context() {
+  static AesCtr ctr;
+  return &ctr;
+}
+
+std::string decrypt_256_aes_ctr(const std::string_view& value) {
+  try {
+    std::string decoded_value = base64_decode(value);
+    if (decoded_value.length() < 16) {
+      return "";
+    }
+
+    uint8_t *data = (uint8_t*)decoded_value.data();
+
+    AesCtr *ctr = aes_ctr_context();
+    ctr->setIV(data, 16);
+    ctr->decrypt(data + 16, decoded_value.length() - 16);
+
+    // Shifted in place, the string is returned without a copy
+    decoded_value.erase(0, 16);
+    return decoded_value;
+  } catch (...) {
+    return "";
+  }
+}
+
+#endif
+/* #endregion */
+
+#endif
@@ -0,0 +1,157 @@
+#include "pico/platform.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+
+#include "./config.h"
+#include "Crypto/Crypto.h"
+#include "Crypto/AES.h"
+#include "./aes-key.cpp"
+
+#ifndef __AES_FAST_CPP__
+#define __AES_FAST_CPP__
+
+// 4 tables (4 KB of SRAM) or 1 table (1 KB) rotated for the other three rows
+#ifndef AES_FAST_TABLES
+#define AES_FAST_TABLES 4
+#endif
+
+static_assert(AES_FAST_TABLES == 1 || AES_FAST_TABLES == 4, "AES_FAST_TABLES must be 1 or 4");
+
+typedef std::array<uint32_t, 256> AES_FAST_TABLE_T;
+
+__force_inline constexpr uint32_t aes_fast_rotl(const uint32_t &value, const uint8_t &shift) {
+  return shift == 0 ? value : (value << shift) | (value >> (32 - shift));
+}
+
+/**
+ * SubBytes and MixColumns of one byte of a column, a column is a little
+ * endian word so row 0 is the lowest byte. The table of row `n` is the
+ * table of row 0 rotated by `n` bytes.
+ */
+constexpr AES_FAST_TABLE_T aes_fast_table(const uint8_t &row) {
+  AES_FAST_TABLE_T table = {};
+
+  for (size_t i = 0; i < table.size(); i++) {
+    const uint32_t value = AES_KEY_SBOX[i];
+    const uint32_t doubled = aes_key_xtime(AES_KEY_SBOX[i]);
+
+    table[i] = aes_fast_rotl(doubled | (value << 8) | (value << 16) | ((doubled ^ value) << 24), row * 8);
+  }
+
+  return table;
+}
+
+// The tables are in SRAM, a lookup from flash can wait for an XIP cache miss
+static const AES_FAST_TABLE_T aes_fast_t0 __not_in_flash("aes_fast_tables") = aes_fast_table(0);
+#if AES_FAST_TABLES == 4
+static const AES_FAST_TABLE_T aes_fast_t1 __not_in_flash("aes_fast_tables") = aes_fast_table(1);
+static const AES_FAST_TABLE_T aes_fast_t2 __not_in_flash("aes_fast_tables") = aes_fast_table(2);
+static const AES_FAST_TABLE_T aes_fast_t3 __not_in_flash("aes_fast_tables") = aes_fast_table(3);
+#endif
+
+static __force_inline uint32_t aes_fast_column(const uint32_t &a, const uint32_t &b, const uint32_t &c, const uint32_t &d) {
+#if AES_FAST_TABLES == 4
+  return aes_fast_t0[a & 0xFF] ^ aes_fast_t1[(b >> 8) & 0xFF] ^ aes_fast_t2[(c >> 16) & 0xFF] ^ aes_fast_t3[d >> 24];
+#else
+  return aes_fast_t0[a & 0xFF] ^
+    aes_fast_rotl(aes_fast_t0[(b >> 8) & 0xFF], 8) ^
+    aes_fast_rotl(aes_fast_t0[(c >> 16) & 0xFF], 16) ^
+    aes_fast_rotl(aes_fast_t0[d >> 24], 24);
+#endif
+}
+
+// The S-box is byte 1 of the table of row 0
+static __force_inline uint32_t aes_fast_sub_column(const uint32_t &a, const uint32_t &b, const uint32_t &c, const uint32_t &d) {
+  return ((aes_fast_t0[a & 0xFF] >> 8) & 0xFF) |
+    (aes_fast_t0[(b >> 8) & 0xFF] & 0xFF00) |
+    ((aes_fast_t0[(c >> 16) & 0xFF] << 8) & 0xFF0000) |
+    ((aes_fast_t0[d >> 24] << 16) & 0xFF000000);
+}
+
+static __force_inline uint32_t aes_fast_load(const uint8_t *bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static __force_inline void aes_fast_store(uint8_t *bytes, const uint32_t &word) {
+  bytes[0] = (uint8_t)word;
+  bytes[1] = (uint8_t)(word >> 8);
+  bytes[2] = (uint8_t)(word >> 16);
+  bytes[3] = (uint8_t)(word >> 24);
+}
+
+/**
+ * AES-256 encryption with 32-bit T-tables, a round is 16 table lookups
+ * instead of the byte by byte SubBytes, ShiftRows and MixColumns of
+ * AESCommon. The round keys are kept as words next to the byte schedule
+ * of AES256, which is still used by decryptBlock.
+ */
+class AesFast256 : public AES256 {
+  private:
+    uint32_t keys[60];
+
+    void load_keys() {
+      for (uint8_t i = 0; i < 60; i++) {
+        this->keys[i] = aes_fast_load(this->schedule + i * 4);
+      }
+    }
+
+  public:
+    bool setKey(const uint8_t *key, size_t len) {
+      if (!AES256::setKey(key, len)) {
+        return false;
+      }
+
+      this->load_keys();
+      return true;
+    }
+
+    bool setSchedule(const uint8_t *schedule, size_t len) {
+      if (!AES256::setSchedule(schedule, len)) {
+        return false;
+      }
+
+      this->load_keys();
+      return true;
+    }
+
+    void encryptBlock(uint8_t *output, const uint8_t *input);
+
+    void clear() {
+      AES256::clear();
+      clean(this->keys);
+    }
+};
+
+void __not_in_flash_func(AesFast256::encryptBlock)(uint8_t *output, const uint8_t *input) {
+  const uint32_t *keys = this->keys;
+
+  uint32_t s0 = aes_fast_load(input) ^ keys[0];
+  uint32_t s1 = aes_fast_load(input + 4) ^ keys[1];
+  uint32_t s2 = aes_fast_load(input + 8) ^ keys[2];
+  uint32_t s3 = aes_fast_load(input + 12) ^ keys[3];
+
+  for (uint8_t round = 1; round < 14; round++) {
+    keys += 4;
+
+    // ShiftRows takes row `n` of the column `n` places to the right
+    const uint32_t t0 = aes_fast_column(s0, s1, s2, s3) ^ keys[0];
+    const uint32_t t1 = aes_fast_column(s1, s2, s3, s0) ^ keys[1];
+    const uint32_t t2 = aes_fast_column(s2, s3, s0, s1) ^ keys[2];
+    const uint32_t t3 = aes_fast_column(s3, s0, s1, s2) ^ keys[3];
+
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
+  }
+
+  // The last round has no MixColumns
+  keys += 4;
+  aes_fast_store(output, aes_fast_sub_column(s0, s1, s2, s3) ^ keys[0]);
+  aes_fast_store(output + 4, aes_fast_sub_column(s1, s2, s3, s0) ^ keys[1]);
+  aes_fast_store(output + 8, aes_fast_sub_column(s2, s3, s0, s1) ^ keys[2]);
+  aes_fast_store(output + 12, aes_fast_sub_column(s3, s0, s1, s2) ^ keys[3]);
+}
+
+#endif
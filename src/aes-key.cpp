@@ -0,0 +1,231 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+
+#include "./config.h"
+
+#ifndef __AES_KEY_CPP__
+#define __AES_KEY_CPP__
+
+/**
+ * Compile time base64 decoding and AES-256 key expansion, the round keys of
+ * AES_ENCRYPTION_KEY are generated by the compiler and placed in flash so
+ * the key is never decoded or expanded at runtime.
+ */
+typedef std::array<uint8_t, 32> AES_KEY_T;
+typedef std::array<uint8_t, 240> AES_KEY_SCHEDULE_T;
+typedef std::array<uint8_t, 16> AES_BLOCK_T;
+
+constexpr uint8_t AES_KEY_SBOX[256] = {
+  0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+  0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+  0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+  0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+  0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+  0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+  0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+  0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+  0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+  0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+  0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+  0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+  0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+  0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+  0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+  0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+};
+
+constexpr uint8_t AES_KEY_RCON[8] = { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40 };
+
+constexpr int8_t aes_key_base64_value(const char &c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+' || c == '-') return 62;
+  if (c == '/' || c == '_') return 63;
+  return -1;
+}
+
+/**
+ * Decodes the base64 key in `key`, returns the number of decoded bytes
+ * or -1 if the string is not base64 or longer than a key.
+ */
+constexpr int aes_key_decode_into(const char *base64, AES_KEY_T &key) {
+  uint32_t bits = 0;
+  uint8_t count = 0;
+  size_t written = 0;
+  bool padding = false;
+
+  for (size_t i = 0; base64[i] != '\0'; i++) {
+    if (base64[i] == '=') {
+      padding = true;
+      continue;
+    }
+
+    const int8_t value = aes_key_base64_value(base64[i]);
+    if (value < 0 || padding) {
+      return -1;
+    }
+
+    bits = (bits << 6) | value;
+    if (++count < 4) {
+      continue;
+    }
+
+    for (int8_t shift = 16; shift >= 0; shift -= 8) {
+      if (written >= key.size()) {
+        return -1;
+      }
+
+      key[written++] = (uint8_t)(bits >> shift);
+    }
+
+    bits = 0;
+    count = 0;
+  }
+
+  // The tail of 2 or 3 characters holds 1 or 2 bytes
+  if (count == 1) {
+    return -1;
+  }
+
+  for (uint8_t i = 1; i < count; i++) {
+    if (written >= key.size()) {
+      return -1;
+    }
+
+    key[written++] = (uint8_t)(bits >> (count * 6 - i * 8));
+  }
+
+  return written;
+}
+
+constexpr bool aes_key_is_valid(const char *base64) {
+  AES_KEY_T key = {};
+  return aes_key_decode_into(base64, key) == (int)key.size();
+}
+
+constexpr AES_KEY_T aes_key_decode(const char *base64) {
+  AES_KEY_T key = {};
+  aes_key_decode_into(base64, key);
+  return key;
+}
+
+/**
+ * FIPS-197 key expansion, the schedule has the same layout as the one of AES256::setKey
+ */
+constexpr AES_KEY_SCHEDULE_T aes_key_expand(const AES_KEY_T &key) {
+  AES_KEY_SCHEDULE_T schedule = {};
+
+  for (size_t i = 0; i < key.size(); i++) {
+    schedule[i] = key[i];
+  }
+
+  for (size_t word = 8; word < 60; word++) {
+    uint8_t temp[4] = {
+      schedule[word * 4 - 4], schedule[word * 4 - 3], schedule[word * 4 - 2], schedule[word * 4 - 1]
+    };
+
+    if (word % 8 == 0) {
+      const uint8_t first = temp[0];
+      temp[0] = AES_KEY_SBOX[temp[1]] ^ AES_KEY_RCON[word / 8];
+      temp[1] = AES_KEY_SBOX[temp[2]];
+      temp[2] = AES_KEY_SBOX[temp[3]];
+      temp[3] = AES_KEY_SBOX[first];
+    } else if (word % 8 == 4) {
+      for (uint8_t i = 0; i < 4; i++) {
+        temp[i] = AES_KEY_SBOX[temp[i]];
+      }
+    }
+
+    for (uint8_t i = 0; i < 4; i++) {
+      schedule[word * 4 + i] = schedule[word * 4 - 32 + i] ^ temp[i];
+    }
+  }
+
+  return schedule;
+}
+
+/* #region Known answer test */
+
+constexpr uint8_t aes_key_xtime(const uint8_t &value) {
+  return (uint8_t)((value << 1) ^ ((value & 0x80) != 0 ? 0x1B : 0x00));
+}
+
+/**
+ * Reference AES-256 block encryption, only used to check the key
+ * expansion at compile time
+ */
+constexpr AES_BLOCK_T aes_key_encrypt_block(const AES_KEY_SCHEDULE_T &schedule, const AES_BLOCK_T &input) {
+  AES_BLOCK_T state = {};
+
+  for (uint8_t i = 0; i < 16; i++) {
+    state[i] = input[i] ^ schedule[i];
+  }
+
+  for (uint8_t round = 1; round <= 14; round++) {
+    AES_BLOCK_T shifted = {};
+
+    // SubBytes and ShiftRows, the state is stored column by column
+    for (uint8_t column = 0; column < 4; column++) {
+      for (uint8_t row = 0; row < 4; row++) {
+        shifted[column * 4 + row] = AES_KEY_SBOX[state[((column + row) % 4) * 4 + row]];
+      }
+    }
+
+    for (uint8_t column = 0; column < 4; column++) {
+      const uint8_t *c = &shifted[column * 4];
+
+      if (round == 14) {
+        for (uint8_t row = 0; row < 4; row++) {
+          state[column * 4 + row] = c[row];
+        }
+        continue;
+      }
+
+      const uint8_t all = c[0] ^ c[1] ^ c[2] ^ c[3];
+      for (uint8_t row = 0; row < 4; row++) {
+        state[column * 4 + row] = c[row] ^ all ^ aes_key_xtime(c[row] ^ c[(row + 1) % 4]);
+      }
+    }
+
+    for (uint8_t i = 0; i < 16; i++) {
+      state[i] ^= schedule[round * 16 + i];
+    }
+  }
+
+  return state;
+}
+
+template <size_t N>
+constexpr bool aes_key_equal(const std::array<uint8_t, N> &a, const std::array<uint8_t, N> &b) {
+  for (size_t i = 0; i < N; i++) {
+    if (a[i] != b[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// FIPS-197 appendix C.3
+static_assert(
+  aes_key_equal(
+    aes_key_encrypt_block(
+      aes_key_expand(aes_key_decode("AAECAwQFBgcICQoLDA0ODxAREhMUFRYXGBkaGxwdHh8=")),
+      { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF }
+    ),
+    { 0x8E, 0xA2, 0xB7, 0xCA, 0x51, 0x67, 0x45, 0xBF, 0xEA, 0xFC, 0x49, 0x90, 0x4B, 0x49, 0x60, 0x89 }
+  ),
+  "The AES-256 key expansion doesn't match FIPS-197"
+);
+
+/* #endregion */
+
+#ifdef AES_ENCRYPTION_KEY
+static_assert(aes_key_is_valid(AES_ENCRYPTION_KEY), "AES_ENCRYPTION_KEY must be 32 bytes encoded in base64");
+
+static constexpr AES_KEY_SCHEDULE_T aes_key_schedule = aes_key_expand(aes_key_decode(AES_ENCRYPTION_KEY));
+#endif
+
+#endif
@@ -0,0 +1,356 @@
+#include "pico/platform.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "./config.h"
+#include "Crypto/Crypto.h"
+#include "Crypto/AES.h"
+
+#ifndef __AES_SLICED_CPP__
+#define __AES_SLICED_CPP__
+
+/**
+ * Two blocks are held in 8 words, word `b` has bit `b` of the 32 bytes.
+ * A block is 16 bits of a word, ordered by row then column, so ShiftRows
+ * rotates each 4 bit row and MixColumns moves whole rows.
+ */
+typedef struct AES_SLICED_STATE_T_ {
+  uint32_t bits[8];
+} AES_SLICED_STATE_T;
+
+// Transposes an 8x8 matrix of bits, bit `b` of byte `k` becomes bit `k` of byte `b`
+static __force_inline uint64_t aes_sliced_transpose(uint64_t x) {
+  uint64_t t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+  x ^= t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+  x ^= t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+  x ^= t ^ (t << 28);
+  return x;
+}
+
+/**
+ * The byte at bit `index` of the words, `index` is the row and column
+ * of the state and the block in bit 4
+ */
+static __force_inline uint8_t aes_sliced_byte_index(const uint8_t &index) {
+  return (index & 0x03) * 4 + ((index >> 2) & 0x03);
+}
+
+static __force_inline void aes_sliced_pack(AES_SLICED_STATE_T &state, const uint8_t *first, const uint8_t *second) {
+  for (uint8_t b = 0; b < 8; b++) {
+    state.bits[b] = 0;
+  }
+
+  for (uint8_t group = 0; group < 4; group++) {
+    const uint8_t *block = group < 2 ? first : second;
+    uint64_t x = 0;
+
+    for (uint8_t k = 0; k < 8; k++) {
+      x |= (uint64_t)block[aes_sliced_byte_index(group * 8 + k)] << (k * 8);
+    }
+
+    x = aes_sliced_transpose(x);
+
+    for (uint8_t b = 0; b < 8; b++) {
+      state.bits[b] |= (uint32_t)((x >> (b * 8)) & 0xFF) << (group * 8);
+    }
+  }
+}
+
+static __force_inline void aes_sliced_unpack(uint8_t *first, uint8_t *second, const AES_SLICED_STATE_T &state) {
+  for (uint8_t group = 0; group < 4; group++) {
+    uint8_t *block = group < 2 ? first : second;
+    uint64_t x = 0;
+
+    for (uint8_t b = 0; b < 8; b++) {
+      x |= (uint64_t)((state.bits[b] >> (group * 8)) & 0xFF) << (b * 8);
+    }
+
+    x = aes_sliced_transpose(x);
+
+    for (uint8_t k = 0; k < 8; k++) {
+      block[aes_sliced_byte_index(group * 8 + k)] = (uint8_t)(x >> (k * 8));
+    }
+  }
+}
+
+/**
+ * The S-box of the 32 bytes at once with the circuit of Boyar and Peralta,
+ * "A depth-16 circuit for the AES S-box" (113 gates)
+ */
+static __force_inline void aes_sliced_sub_bytes(AES_SLICED_STATE_T &state) {
+  uint32_t *s = state.bits;
+  const uint32_t U0 = s[7], U1 = s[6], U2 = s[5], U3 = s[4], U4 = s[3], U5 = s[2], U6 = s[1], U7 = s[0];
+
+  const uint32_t T1 = U0 ^ U3;
+  const uint32_t T2 = U0 ^ U5;
+  const uint32_t T3 = U0 ^ U6;
+  const uint32_t T4 = U3 ^ U5;
+  const uint32_t T5 = U4 ^ U6;
+  const uint32_t T6 = T1 ^ T5;
+  const uint32_t T7 = U1 ^ U2;
+  const uint32_t T8 = U7 ^ T6;
+  const uint32_t T9 = U7 ^ T7;
+  const uint32_t T10 = T6 ^ T7;
+  const uint32_t T11 = U1 ^ U5;
+  const uint32_t T12 = U2 ^ U5;
+  const uint32_t T13 = T3 ^ T4;
+  const uint32_t T14 = T6 ^ T11;
+  const uint32_t T15 = T5 ^ T11;
+  const uint32_t T16 = T5 ^ T12;
+  const uint32_t T17 = T9 ^ T16;
+  const uint32_t T18 = U3 ^ U7;
+  const uint32_t T19 = T7 ^ T18;
+  const uint32_t T20 = T1 ^ T19;
+  const uint32_t T21 = U6 ^ U7;
+  const uint32_t T22 = T7 ^ T21;
+  const uint32_t T23 = T2 ^ T22;
+  const uint32_t T24 = T2 ^ T10;
+  const uint32_t T25 = T20 ^ T17;
+  const uint32_t T26 = T3 ^ T16;
+  const uint32_t T27 = T1 ^ T12;
+
+  const uint32_t M1 = T13 & T6;
+  const uint32_t M2 = T23 & T8;
+  const uint32_t M3 = T14 ^ M1;
+  const uint32_t M4 = T19 & U7;
+  const uint32_t M5 = M4 ^ M1;
+  const uint32_t M6 = T3 & T16;
+  const uint32_t M7 = T22 & T9;
+  const uint32_t M8 = T26 ^ M6;
+  const uint32_t M9 = T20 & T17;
+  const uint32_t M10 = M9 ^ M6;
+  const uint32_t M11 = T1 & T15;
+  const uint32_t M12 = T4 & T27;
+  const uint32_t M13 = M12 ^ M11;
+  const uint32_t M14 = T2 & T10;
+  const uint32_t M15 = M14 ^ M11;
+  const uint32_t M16 = M3 ^ M2;
+  const uint32_t M17 = M5 ^ T24;
+  const uint32_t M18 = M8 ^ M7;
+  const uint32_t M19 = M10 ^ M15;
+  const uint32_t M20 = M16 ^ M13;
+  const uint32_t M21 = M17 ^ M15;
+  const uint32_t M22 = M18 ^ M13;
+  const uint32_t M23 = M19 ^ T25;
+  const uint32_t M24 = M22 ^ M23;
+  const uint32_t M25 = M22 & M20;
+  const uint32_t M26 = M21 ^ M25;
+  const uint32_t M27 = M20 ^ M21;
+  const uint32_t M28 = M23 ^ M25;
+  const uint32_t M29 = M28 & M27;
+  const uint32_t M30 = M26 & M24;
+  const uint32_t M31 = M20 & M23;
+  const uint32_t M32 = M27 & M31;
+  const uint32_t M33 = M27 ^ M25;
+  const uint32_t M34 = M21 & M22;
+  const uint32_t M35 = M24 & M34;
+  const uint32_t M36 = M24 ^ M25;
+  const uint32_t M37 = M21 ^ M29;
+  const uint32_t M38 = M32 ^ M33;
+  const uint32_t M39 = M23 ^ M30;
+  const uint32_t M40 = M35 ^ M36;
+  const uint32_t M41 = M38 ^ M40;
+  const uint32_t M42 = M37 ^ M39;
+  const uint32_t M43 = M37 ^ M38;
+  const uint32_t M44 = M39 ^ M40;
+  const uint32_t M45 = M42 ^ M41;
+  const uint32_t M46 = M44 & T6;
+  const uint32_t M47 = M40 & T8;
+  const uint32_t M48 = M39 & U7;
+  const uint32_t M49 = M43 & T16;
+  const uint32_t M50 = M38 & T9;
+  const uint32_t M51 = M37 & T17;
+  const uint32_t M52 = M42 & T15;
+  const uint32_t M53 = M45 & T27;
+  const uint32_t M54 = M41 & T10;
+  const uint32_t M55 = M44 & T13;
+  const uint32_t M56 = M40 & T23;
+  const uint32_t M57 = M39 & T19;
+  const uint32_t M58 = M43 & T3;
+  const uint32_t M59 = M38 & T22;
+  const uint32_t M60 = M37 & T20;
+  const uint32_t M61 = M42 & T1;
+  const uint32_t M62 = M45 & T4;
+  const uint32_t M63 = M41 & T2;
+
+  const uint32_t L0 = M61 ^ M62;
+  const uint32_t L1 = M50 ^ M56;
+  const uint32_t L2 = M46 ^ M48;
+  const uint32_t L3 = M47 ^ M55;
+  const uint32_t L4 = M54 ^ M58;
+  const uint32_t L5 = M49 ^ M61;
+  const uint32_t L6 = M62 ^ L5;
+  const uint32_t L7 = M46 ^ L3;
+  const uint32_t L8 = M51 ^ M59;
+  const uint32_t L9 = M52 ^ M53;
+  const uint32_t L10 = M53 ^ L4;
+  const uint32_t L11 = M60 ^ L2;
+  const uint32_t L12 = M48 ^ M51;
+  const uint32_t L13 = M50 ^ L0;
+  const uint32_t L14 = M52 ^ M61;
+  const uint32_t L15 = M55 ^ L1;
+  const uint32_t L16 = M56 ^ L0;
+  const uint32_t L17 = M57 ^ L1;
+  const uint32_t L18 = M58 ^ L8;
+  const uint32_t L19 = M63 ^ L4;
+  const uint32_t L20 = L0 ^ L1;
+  const uint32_t L21 = L1 ^ L7;
+  const uint32_t L22 = L3 ^ L12;
+  const uint32_t L23 = L18 ^ L2;
+  const uint32_t L24 = L15 ^ L9;
+  const uint32_t L25 = L6 ^ L10;
+  const uint32_t L26 = L7 ^ L9;
+  const uint32_t L27 = L8 ^ L10;
+  const uint32_t L28 = L11 ^ L14;
+  const uint32_t L29 = L11 ^ L17;
+
+  s[7] = L6 ^ L24;
+  s[6] = ~(L16 ^ L26);
+  s[5] = ~(L19 ^ L28);
+  s[4] = L6 ^ L21;
+  s[3] = L20 ^ L22;
+  s[2] = L25 ^ L29;
+  s[1] = ~(L13 ^ L27);
+  s[0] = ~(L6 ^ L23);
+}
+
+// Row `n` is rotated by `n` columns, the same for the 8 words
+static __force_inline uint32_t aes_sliced_shift_rows(const uint32_t &x) {
+  return (x & 0x000F000F) |
+    ((x >> 1) & 0x00700070) | ((x << 3) & 0x00800080) |
+    ((x >> 2) & 0x03000300) | ((x << 2) & 0x0C000C00) |
+    ((x >> 3) & 0x10001000) | ((x << 1) & 0xE000E000);
+}
+
+// Row `n` of the result is row `n + 1` of the column
+static __force_inline uint32_t aes_sliced_next_row(const uint32_t &x) {
+  return ((x >> 4) & 0x0FFF0FFF) | ((x << 12) & 0xF000F000);
+}
+
+static __force_inline uint32_t aes_sliced_opposite_row(const uint32_t &x) {
+  return ((x >> 8) & 0x00FF00FF) | ((x << 8) & 0xFF00FF00);
+}
+
+static __force_inline uint32_t aes_sliced_previous_row(const uint32_t &x) {
+  return ((x >> 12) & 0x000F000F) | ((x << 4) & 0xFFF0FFF0);
+}
+
+/**
+ * 2a ^ 3b ^ c ^ d for the rows a, b, c and d of a column, computed as
+ * 2 (a ^ b) ^ b ^ c ^ d where the doubling moves bits between the words
+ */
+static __force_inline void aes_sliced_mix_columns(AES_SLICED_STATE_T &state) {
+  uint32_t *s = state.bits;
+  uint32_t sum[8];
+  uint32_t rest[8];
+
+  for (uint8_t b = 0; b < 8; b++) {
+    const uint32_t next = aes_sliced_next_row(s[b]);
+
+    sum[b] = s[b] ^ next;
+    rest[b] = next ^ aes_sliced_opposite_row(s[b]) ^ aes_sliced_previous_row(s[b]);
+  }
+
+  s[0] = sum[7] ^ rest[0];
+  s[1] = sum[0] ^ sum[7] ^ rest[1];
+  s[2] = sum[1] ^ rest[2];
+  s[3] = sum[2] ^ sum[7] ^ rest[3];
+  s[4] = sum[3] ^ sum[7] ^ rest[4];
+  s[5] = sum[4] ^ rest[5];
+  s[6] = sum[5] ^ rest[6];
+  s[7] = sum[6] ^ rest[7];
+}
+
+/**
+ * Bitsliced AES-256 encryption of two blocks at once, it has no table
+ * lookups or branches on the data so its timing doesn't depend on the key
+ * or the message. CTR mode asks for the keystream in pairs through
+ * encryptBlocks, decryptBlock is the one of AES256.
+ */
+class AesSliced256 : public AES256 {
+  private:
+    // The round keys packed for both blocks
+    AES_SLICED_STATE_T keys[15];
+
+    void load_keys() {
+      for (uint8_t round = 0; round < 15; round++) {
+        const uint8_t *key = this->schedule + round * 16;
+        aes_sliced_pack(this->keys[round], key, key);
+      }
+    }
+
+  public:
+    bool setKey(const uint8_t *key, size_t len) {
+      if (!AES256::setKey(key, len)) {
+        return false;
+      }
+
+      this->load_keys();
+      return true;
+    }
+
+    bool setSchedule(const uint8_t *schedule, size_t len) {
+      if (!AES256::setSchedule(schedule, len)) {
+        return false;
+      }
+
+      this->load_keys();
+      return true;
+    }
+
+    void encryptBlock(uint8_t *output, const uint8_t *input) {
+      this->encryptBlocks(output, input, 1);
+    }
+
+    void encryptBlocks(uint8_t *output, const uint8_t *input, size_t count);
+
+    void clear() {
+      AES256::clear();
+      clean(this->keys);
+    }
+};
+
+void __not_in_flash_func(AesSliced256::encryptBlocks)(uint8_t *output, const uint8_t *input, size_t count) {
+  AES_SLICED_STATE_T state;
+
+  while (count > 0) {
+    // A single block is encrypted twice and the second copy is dropped
+    uint8_t second[16];
+    const uint8_t *second_input = count > 1 ? input + 16 : input;
+
+    aes_sliced_pack(state, input, second_input);
+
+    for (uint8_t round = 0; round < 15; round++) {
+      if (round > 0) {
+        aes_sliced_sub_bytes(state);
+
+        for (uint8_t b = 0; b < 8; b++) {
+          state.bits[b] = aes_sliced_shift_rows(state.bits[b]);
+        }
+
+        if (round < 14) {
+          aes_sliced_mix_columns(state);
+        }
+      }
+
+      for (uint8_t b = 0; b < 8; b++) {
+        state.bits[b] ^= this->keys[round].bits[b];
+      }
+    }
+
+    aes_sliced_unpack(output, count > 1 ? output + 16 : second, state);
+    clean(second);
+
+    const size_t done = count > 1 ? 2 : 1;
+    input += done * 16;
+    output += done * 16;
+    count -= done;
+  }
+
+  clean(state);
+}
+
+#endif
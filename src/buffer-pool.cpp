@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "./config.h"
+
+#ifndef __BUFFER_POOL_CPP__
+#define __BUFFER_POOL_CPP__
+
+#ifndef TCP_SERVER_BUFFER_POOL_SIZE
+#define TCP_SERVER_BUFFER_POOL_SIZE 4
+#endif
+
+/**
+ * Buffers of TCP_SERVER_BUF_SIZE bytes shared by all the clients.
+ *
+ * A client only holds a buffer while it has a partially received frame
+ * or a frame waiting to be written to lwIP, so idle connections don't use
+ * any buffer memory. A broadcast frame is built once and the same buffer
+ * is referenced by every client it's queued to.
+ */
+typedef struct BUFFER_POOL_T_ {
+  alignas(4) uint8_t buffers[TCP_SERVER_BUFFER_POOL_SIZE][TCP_SERVER_BUF_SIZE];
+  uint8_t refs[TCP_SERVER_BUFFER_POOL_SIZE] = {};
+  uint16_t free = TCP_SERVER_BUFFER_POOL_SIZE;
+  // Set by the server to continue the clients waiting for a buffer, called
+  // when a buffer is freed while none was free
+  void (*notify)(void) = nullptr;
+} BUFFER_POOL_T;
+
+static BUFFER_POOL_T buffer_pool;
+
+static size_t buffer_pool_index(const uint8_t *buffer) {
+  return (buffer - buffer_pool.buffers[0]) / TCP_SERVER_BUF_SIZE;
+}
+
+/**
+ * Returns a buffer with one reference, or NULL when all the buffers are in use
+ */
+uint8_t* buffer_pool_acquire() {
+  for (uint16_t i = 0; i < TCP_SERVER_BUFFER_POOL_SIZE; i++) {
+    if (buffer_pool.refs[i] == 0) {
+      buffer_pool.refs[i] = 1;
+      buffer_pool.free--;
+      return buffer_pool.buffers[i];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Adds a reference, returns false if the buffer can't be shared anymore
+ */
+bool buffer_pool_retain(uint8_t *buffer) {
+  const size_t index = buffer_pool_index(buffer);
+  if (index >= TCP_SERVER_BUFFER_POOL_SIZE || buffer_pool.refs[index] == 0 || buffer_pool.refs[index] == UINT8_MAX) {
+    return false;
+  }
+
+  buffer_pool.refs[index]++;
+  return true;
+}
+
+/**
+ * Drops a reference, the buffer is free once the last one is released
+ */
+void buffer_pool_release(uint8_t *buffer) {
+  if (buffer == NULL) {
+    return;
+  }
+
+  const size_t index = buffer_pool_index(buffer);
+  if (index < TCP_SERVER_BUFFER_POOL_SIZE && buffer_pool.refs[index] > 0) {
+    if (--buffer_pool.refs[index] == 0 && buffer_pool.free++ == 0 && buffer_pool.notify != nullptr) {
+      buffer_pool.notify();
+    }
+  }
+}
+
+uint16_t buffer_pool_free() {
+  return buffer_pool.free;
+}
+
+#endif
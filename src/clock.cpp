@@ -0,0 +1,36 @@
+#include "pico/stdlib.h"
+#include <stdint.h>
+
+#ifndef __CLOCK_CPP__
+#define __CLOCK_CPP__
+
+/**
+ * Monotonic clock since boot, used for the protocol timers.
+ *
+ * Unlike the RTC it has a real millisecond resolution and it doesn't
+ * jump when the time is set by NTP.
+ */
+inline uint64_t clock_us() {
+  return time_us_64();
+}
+
+inline uint64_t clock_ms() {
+  return time_us_64() / 1000;
+}
+
+// Epoch time at boot in microseconds, set once NTP is synced
+static int64_t clock_epoch_offset_us = 0;
+
+void clock_set_epoch_us(const uint64_t &epoch_us) {
+  clock_epoch_offset_us = (int64_t)epoch_us - (int64_t)time_us_64();
+}
+
+/**
+ * Wall clock time in microseconds since 1 Jan 1970, before NTP is synced
+ * it's the time since boot.
+ */
+inline uint64_t clock_epoch_us() {
+  return clock_epoch_offset_us + time_us_64();
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include <stdint.h>
+
+#include "./spsc-queue.cpp"
+
+#ifndef __COMMAND_QUEUE_CPP__
+#define __COMMAND_QUEUE_CPP__
+
+#ifndef SERVICE_COMMAND_QUEUE_SIZE
+#define SERVICE_COMMAND_QUEUE_SIZE 8
+#endif
+
+/**
+ * Carries the state changing commands from the network on core 0 to the
+ * service on core 1, so the actuators and the service state are only
+ * touched by core 1 and the network never waits for the service.
+ *
+ * Every command gets a token, core 1 returns the token once the command
+ * is applied and core 0 replies to the client that sent it.
+ */
+template <typename T>
+class CommandQueue {
+  private:
+    typedef struct COMMAND_T_ {
+      uint32_t token;
+      T command;
+    } COMMAND_T;
+
+    SpscQueue<COMMAND_T, SERVICE_COMMAND_QUEUE_SIZE> commands;
+    SpscQueue<uint32_t, SERVICE_COMMAND_QUEUE_SIZE> completed;
+
+    // Only used on core 0
+    uint32_t next_token = 1;
+    uint8_t in_flight = 0;
+
+  public:
+    // Set by the server to wake up core 0 when a command is completed
+    void (*volatile notify)(void) = nullptr;
+
+    /**
+     * Called on core 0, returns the token of the command or 0 when there
+     * are already SERVICE_COMMAND_QUEUE_SIZE commands not completed.
+     */
+    uint32_t submit(const T &command) {
+      if (this->in_flight >= SERVICE_COMMAND_QUEUE_SIZE) {
+        return 0;
+      }
+
+      const uint32_t token = this->next_token;
+      this->next_token = token == UINT32_MAX ? 1 : token + 1;
+
+      if (!this->commands.push({ token, command })) {
+        return 0;
+      }
+
+      this->in_flight++;
+      return token;
+    }
+
+    /**
+     * Called on core 1, applies the waiting commands in order
+     */
+    template <typename Fn>
+    void process(Fn apply) {
+      COMMAND_T entry;
+      bool completed = false;
+
+      while (this->commands.pop(entry)) {
+        apply(entry.command);
+
+        // There is room, the tokens not returned yet are counted in `in_flight`
+        this->completed.push(entry.token);
+        completed = true;
+      }
+
+      void (*notify)(void) = this->notify;
+      if (completed && notify != nullptr) {
+        notify();
+      }
+    }
+
+    /**
+     * Called on core 0, returns false when there is no completed command
+     */
+    bool complete(uint32_t &token) {
+      if (!this->completed.pop(token)) {
+        return false;
+      }
+
+      this->in_flight--;
+      return true;
+    }
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+#include <type_traits>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#include "./config.h"
+#include "./types.cpp"
+#include "./spsc-queue.cpp"
+#include "./seqlock.cpp"
+
+#ifndef INCLUDE_NLOHMANN_JSON_HPP_
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+#endif
+
+#ifndef __EVENT_BUS_CPP__
+#define __EVENT_BUS_CPP__
+
+#ifndef EVENT_BUS_INTERVAL_MS
+#define EVENT_BUS_INTERVAL_MS 250
+#endif
+
+#define EVENT_BUS_MAX_TOPICS 8
+// Fields a client can subscribe to with the SUBSCRIBE packet
+#define EVENT_BUS_MAX_FIELD_SUBSCRIPTIONS 8
+
+typedef struct FIELD_SUBSCRIPTION_T_ {
+  uint8_t topic;
+  uint8_t field;
+  // Minimum change of the value before it's pushed again
+  float threshold;
+  // The value last pushed to the client
+  double last;
+  bool has_last;
+} FIELD_SUBSCRIPTION_T;
+
+enum class EVENT_POLICY {
+  // Only the last published value is kept, subscribers get it at most once per interval
+  LATEST_WINS,
+  // Every published value is sent to the subscribers in order
+  QUEUED
+};
+
+/**
+ * A topic is published from core 1 (loop or alarm callbacks) and read
+ * on core 0 by the sender, publishing never blocks or allocates.
+ */
+class EventTopic {
+  public:
+    const char *name;
+    const PACKET_TYPE type;
+    const EVENT_POLICY policy;
+    // The fields of the data that can be subscribed to, their values are numbers or booleans
+    const char *const *fields;
+    const uint8_t fields_count;
+    uint8_t id = 0;
+
+    EventTopic(const char *name, const PACKET_TYPE &type, const EVENT_POLICY &policy, const char *const *fields, const uint8_t &fields_count);
+
+    /**
+     * Returns -1 if the topic doesn't have the field
+     */
+    int8_t field_index(const std::string &field) const {
+      for (uint8_t i = 0; i < this->fields_count; i++) {
+        if (field == this->fields[i]) {
+          return i;
+        }
+      }
+
+      return -1;
+    }
+
+    /**
+     * Called on core 0, returns true with the packet data when there is a new value
+     */
+    virtual bool take(json &data) = 0;
+};
+
+typedef struct EVENT_BUS_T_ {
+  EventTopic *topics[EVENT_BUS_MAX_TOPICS];
+  uint8_t count;
+  // Set by the server to wake up core 0 after a publish, it can be called from core 1
+  void (*volatile notify)(void);
+} EVENT_BUS_T;
+
+// Constant initialized, the topics can register from static constructors in any order
+static EVENT_BUS_T event_bus = {};
+
+static void event_bus_notify() {
+  void (*notify)(void) = event_bus.notify;
+  if (notify != nullptr) {
+    notify();
+  }
+}
+
+EventTopic::EventTopic(
+  const char *name, const PACKET_TYPE &type, const EVENT_POLICY &policy, const char *const *fields, const uint8_t &fields_count
+) : name(name), type(type), policy(policy), fields(fields), fields_count(fields_count) {
+  if (event_bus.count >= EVENT_BUS_MAX_TOPICS) {
+    printf("[Event-Bus] Too many topics, %s is ignored\n", name);
+    return;
+  }
+
+  this->id = event_bus.count;
+  event_bus.topics[event_bus.count++] = this;
+}
+
+EventTopic* event_bus_find(const std::string &name) {
+  for (uint8_t i = 0; i < event_bus.count; i++) {
+    if (name == event_bus.topics[i]->name) {
+      return event_bus.topics[i];
+    }
+  }
+
+  return nullptr;
+}
+
+/**
+ * Latest-wins topic, the value is published with a Seqlock
+ */
+template <typename T>
+class LatestEventTopic : public EventTopic {
+  private:
+    Seqlock<T> value;
+    uint32_t last_sequence = 0;
+
+  public:
+    LatestEventTopic(
+      const char *name, const PACKET_TYPE &type, const char *const *fields = nullptr, const uint8_t &fields_count = 0
+    ) : EventTopic(name, type, EVENT_POLICY::LATEST_WINS, fields, fields_count) {}
+
+    void publish(const T &value) {
+      this->value.store(value);
+      event_bus_notify();
+    }
+
+    bool take(json &data) override {
+      T value;
+      uint32_t sequence = 0;
+
+      if (!this->value.try_load(value, sequence) || sequence == this->last_sequence) {
+        return false;
+      }
+
+      this->last_sequence = sequence;
+      data = value;
+      return true;
+    }
+};
+
+/**
+ * Queued topic, a single producer single consumer ring of `N` values.
+ * A value published while the ring is full is dropped.
+ */
+template <typename T, uint8_t N>
+class QueuedEventTopic : public EventTopic {
+  private:
+    SpscQueue<T, N> values;
+
+  public:
+    uint32_t dropped = 0;
+
+    QueuedEventTopic(const char *name, const PACKET_TYPE &type) : EventTopic(name, type, EVENT_POLICY::QUEUED, nullptr, 0) {}
+
+    bool publish(const T &value) {
+      // The loop and the alarm callbacks on core 1 are a single producer
+      const uint32_t interrupts = save_and_disable_interrupts();
+      const bool pushed = this->values.push(value);
+
+      if (!pushed) {
+        this->dropped++;
+      }
+
+      restore_interrupts(interrupts);
+
+      if (pushed) {
+        event_bus_notify();
+      }
+
+      return pushed;
+    }
+
+    bool take(json &data) override {
+      T value;
+      if (!this->values.pop(value)) {
+        return false;
+      }
+
+      data = value;
+      return true;
+    }
+};
+
+#endif
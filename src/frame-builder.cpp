@@ -0,0 +1,185 @@
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+
+#include "./config.h"
+#include "./aes-ctr.cpp"
+
+#ifndef INCLUDE_NLOHMANN_JSON_HPP_
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+#endif
+
+#ifndef __FRAME_BUILDER_CPP__
+#define __FRAME_BUILDER_CPP__
+
+/**
+ * Output adapter for the JSON serializer that writes in a fixed buffer,
+ * the `overflow` flag is set instead of growing the buffer.
+ * Without a buffer the characters are only counted.
+ */
+class FrameOutputAdapter : public nlohmann::detail::output_adapter_protocol<char> {
+  public:
+    uint8_t *data = nullptr;
+    size_t capacity = 0;
+    size_t length = 0;
+    bool overflow = false;
+
+    void reset(uint8_t *data, const size_t &capacity) {
+      this->data = data;
+      this->capacity = capacity;
+      this->length = 0;
+      this->overflow = false;
+    }
+
+    void write_character(char c) override {
+      if (this->length >= this->capacity) {
+        this->overflow = true;
+        return;
+      }
+
+      if (this->data != nullptr) {
+        this->data[this->length] = c;
+      }
+
+      this->length++;
+    }
+
+    void write_characters(const char *s, std::size_t length) override {
+      if (length > this->capacity - this->length) {
+        this->overflow = true;
+        return;
+      }
+
+      if (this->data != nullptr) {
+        memcpy(this->data + this->length, s, length);
+      }
+
+      this->length += length;
+    }
+};
+
+// The serializer and its adapter are created once, building a frame doesn't allocate
+static std::shared_ptr<FrameOutputAdapter> frame_output_adapter = std::make_shared<FrameOutputAdapter>();
+static nlohmann::detail::serializer<json> frame_serializer(frame_output_adapter, ' ');
+
+static const char frame_base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Encodes `len` bytes to base64, the input can overlap the output as long as it
+ * starts at least `(len + 2) / 3` bytes after it. Returns the encoded length.
+ */
+static size_t frame_base64_encode(const uint8_t *input, const size_t &len, uint8_t *output) {
+  size_t written = 0;
+
+  for (size_t i = 0; i < len; i += 3) {
+    const uint8_t b0 = input[i];
+    const uint8_t b1 = i + 1 < len ? input[i + 1] : 0;
+    const uint8_t b2 = i + 2 < len ? input[i + 2] : 0;
+
+    output[written++] = frame_base64_chars[b0 >> 2];
+    output[written++] = frame_base64_chars[((b0 & 0x03) << 4) | (b1 >> 4)];
+    output[written++] = i + 1 < len ? frame_base64_chars[((b1 & 0x0F) << 2) | (b2 >> 6)] : '=';
+    output[written++] = i + 2 < len ? frame_base64_chars[b2 & 0x3F] : '=';
+  }
+
+  return written;
+}
+
+static uint8_t frame_count_digits(size_t value) {
+  uint8_t digits = 1;
+  while (value >= 10) {
+    value /= 10;
+    digits++;
+  }
+
+  return digits;
+}
+
+/**
+ * The capacity `frame_build` needs for the packet, the JSON is serialized
+ * once without being stored to count its length.
+ */
+size_t frame_capacity(const json &packet) {
+  frame_output_adapter->reset(nullptr, SIZE_MAX);
+  frame_serializer.dump(packet, false, false, 0);
+
+  size_t data_len = frame_output_adapter->length;
+
+#ifdef AES_ENCRYPTION_KEY
+  data_len = (16 + data_len + 2) / 3 * 4;
+#endif
+
+  // The prefix reserved by frame_build is as wide as the capacity itself
+  const size_t capacity = data_len + frame_count_digits(data_len) + 1;
+  return frame_count_digits(capacity) > frame_count_digits(data_len) ? capacity + 1 : capacity;
+}
+
+/**
+ * Builds the `number_of_characters;data` frame of a packet in `buffer`.
+ *
+ * The space for the widest length prefix is reserved first, the JSON is serialized,
+ * encrypted and base64 encoded in place after it and then the prefix is written
+ * right before the data. The frame is `len` bytes starting at `offset`,
+ * returns false if it doesn't fit in `capacity` bytes.
+ */
+bool frame_build(const json &packet, uint8_t *buffer, const size_t &capacity, uint16_t *offset, uint16_t *len) {
+  const size_t prefix_size = frame_count_digits(capacity) + 1;
+  if (capacity <= prefix_size) {
+    return false;
+  }
+
+#ifdef AES_ENCRYPTION_KEY
+  // The JSON goes after the IV, it's moved later once its length is known
+  const size_t iv_size = 16;
+  if (capacity <= prefix_size + iv_size) {
+    return false;
+  }
+
+  frame_output_adapter->reset(buffer + prefix_size + iv_size, capacity - prefix_size - iv_size);
+#else
+  frame_output_adapter->reset(buffer + prefix_size, capacity - prefix_size);
+#endif
+
+  frame_serializer.dump(packet, false, false, 0);
+  if (frame_output_adapter->overflow) {
+    return false;
+  }
+
+  size_t data_len = frame_output_adapter->length;
+
+#ifdef AES_ENCRYPTION_KEY
+  const size_t raw_len = iv_size + data_len;
+  const size_t chunks = (raw_len + 2) / 3;
+  if (prefix_size + chunks * 4 > capacity) {
+    return false;
+  }
+
+  // The raw data must start `chunks` bytes after the output to be base64 encoded in place
+  uint8_t *raw = buffer + prefix_size + chunks;
+  memmove(raw + iv_size, buffer + prefix_size + iv_size, data_len);
+  random_fill(raw, iv_size);
+
+  AesCtr *ctr = aes_ctr_context();
+  ctr->setIV(raw, iv_size);
+  ctr->encrypt(raw + iv_size, data_len);
+
+  data_len = frame_base64_encode(raw, raw_len, buffer + prefix_size);
+#endif
+
+  const uint8_t digits = frame_count_digits(data_len);
+  *offset = prefix_size - digits - 1;
+  *len = digits + 1 + data_len;
+
+  size_t value = data_len;
+  for (uint8_t i = digits; i > 0; i--) {
+    buffer[*offset + i - 1] = '0' + value % 10;
+    value /= 10;
+  }
+
+  buffer[prefix_size - 1] = ';';
+  return true;
+}
+
+#endif
@@ -0,0 +1,190 @@
+#include "lwip/pbuf.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef __FRAME_CPP__
+#define __FRAME_CPP__
+
+/**
+ * Consumer for frames larger than the receive buffer, the payload is written
+ * in chunks as it arrives instead of being copied in the buffer.
+ */
+class FrameStream {
+  public:
+    /**
+     * The maximum payload size accepted by the stream
+     */
+    virtual uint32_t max_size() = 0;
+    /**
+     * Returns false if the stream can't take a frame from this owner
+     */
+    virtual bool begin(const void *owner, const uint32_t &len) = 0;
+    virtual bool write(const uint8_t *data, const size_t &len) = 0;
+    virtual void release(const void *owner) = 0;
+};
+
+/**
+ * Incremental decoder for the `number_of_characters;data` packet format.
+ *
+ * The decoder is fed the raw TCP stream in any chunking and copies only the
+ * data part into the caller's buffer, the length prefix is never stored.
+ * Frames that don't fit in the buffer are passed to a FrameStream if one is given.
+ */
+enum class FRAME_STATE {
+  LENGTH,
+  PAYLOAD,
+  COMPLETE,
+  MALFORMED
+};
+
+typedef struct FRAME_DECODER_T_ {
+  FRAME_STATE state = FRAME_STATE::LENGTH;
+  uint32_t packet_len = 0;
+  uint32_t recv_len = 0;
+  uint8_t digits = 0;
+  FrameStream *stream = nullptr;
+} FRAME_DECODER_T;
+
+void frame_decoder_reset(FRAME_DECODER_T *decoder) {
+  if (decoder->stream != nullptr) {
+    decoder->stream->release(decoder);
+    decoder->stream = nullptr;
+  }
+
+  decoder->state = FRAME_STATE::LENGTH;
+  decoder->packet_len = 0;
+  decoder->recv_len = 0;
+  decoder->digits = 0;
+}
+
+/**
+ * True when no byte of the next frame was received yet
+ */
+bool frame_decoder_idle(const FRAME_DECODER_T *decoder) {
+  return decoder->state == FRAME_STATE::LENGTH && decoder->digits == 0;
+}
+
+/**
+ * Feeds `len` bytes to the decoder, the payload is copied in `buffer`.
+ *
+ * Stops right after a frame is completed so the caller can dispatch it,
+ * the returned value is the number of bytes consumed from `data`.
+ * When `decoder->stream` is set after a frame is completed, the payload
+ * was written to that stream and not to the buffer.
+ */
+size_t frame_decoder_feed(
+  FRAME_DECODER_T *decoder,
+  uint8_t *buffer, const size_t &buffer_size, FrameStream *stream,
+  const uint8_t *data, const size_t &len
+) {
+  const uint32_t max_size = stream != nullptr && stream->max_size() > buffer_size ? stream->max_size() : buffer_size;
+
+  size_t consumed = 0;
+
+  while (consumed < len) {
+    switch (decoder->state) {
+      case FRAME_STATE::LENGTH: {
+        const uint8_t c = data[consumed++];
+
+        if (c == ';') {
+          if (decoder->digits == 0 || decoder->packet_len == 0) {
+            decoder->state = FRAME_STATE::MALFORMED;
+            return consumed;
+          }
+
+          if (decoder->packet_len > buffer_size) {
+            if (stream == nullptr || !stream->begin(decoder, decoder->packet_len)) {
+              decoder->state = FRAME_STATE::MALFORMED;
+              return consumed;
+            }
+
+            decoder->stream = stream;
+          }
+
+          decoder->state = FRAME_STATE::PAYLOAD;
+          break;
+        }
+
+        if (c < '0' || c > '9') {
+          decoder->state = FRAME_STATE::MALFORMED;
+          return consumed;
+        }
+
+        decoder->packet_len = decoder->packet_len * 10 + (c - '0');
+        decoder->digits++;
+
+        if (decoder->packet_len > max_size) {
+          decoder->state = FRAME_STATE::MALFORMED;
+          return consumed;
+        }
+        break;
+      }
+      case FRAME_STATE::PAYLOAD: {
+        size_t chunk = decoder->packet_len - decoder->recv_len;
+        if (chunk > len - consumed) {
+          chunk = len - consumed;
+        }
+
+        if (decoder->stream != nullptr) {
+          if (!decoder->stream->write(data + consumed, chunk)) {
+            decoder->state = FRAME_STATE::MALFORMED;
+            return consumed + chunk;
+          }
+        } else {
+          memcpy(buffer + decoder->recv_len, data + consumed, chunk);
+        }
+
+        decoder->recv_len += chunk;
+        consumed += chunk;
+
+        if (decoder->recv_len == decoder->packet_len) {
+          decoder->state = FRAME_STATE::COMPLETE;
+          return consumed;
+        }
+        break;
+      }
+      default:
+        return consumed;
+    }
+  }
+
+  return consumed;
+}
+
+/**
+ * Walks the pbuf chain from `offset` and feeds it to the decoder,
+ * the returned value is the number of bytes consumed from the chain.
+ */
+uint16_t frame_decoder_feed_pbuf(
+  FRAME_DECODER_T *decoder,
+  uint8_t *buffer, const size_t &buffer_size, FrameStream *stream,
+  struct pbuf *p, const uint16_t &offset
+) {
+  uint16_t skip = offset;
+  uint16_t consumed = 0;
+
+  for (struct pbuf *q = p; q != NULL; q = q->next) {
+    if (skip >= q->len) {
+      skip -= q->len;
+      continue;
+    }
+
+    const size_t chunk = q->len - skip;
+    const size_t used = frame_decoder_feed(
+      decoder, buffer, buffer_size, stream,
+      static_cast<const uint8_t*>(q->payload) + skip, chunk
+    );
+
+    consumed += used;
+    skip = 0;
+
+    if (used < chunk || decoder->state == FRAME_STATE::COMPLETE || decoder->state == FRAME_STATE::MALFORMED) {
+      break;
+    }
+  }
+
+  return consumed;
+}
+
+#endif
@@ -2,9 +2,14 @@
 #include "pico/stdlib.h"
 #include "lwip/pbuf.h"
 #include "lwip/tcp.h"
+#include <string_view>
+#include <stdexcept>
+#include <algorithm>
 
 #include "./server-utils.cpp"
 #include "./sender.cpp"
+#include "./peer.cpp"
+#include "./idempotency-cache.cpp"
 #include "./types.cpp"
 
 #ifndef INCLUDE_NLOHMANN_JSON_HPP_
@@ -16,38 +21,246 @@ using json = nlohmann::json;
 #ifndef __HANDLER_CPP__
 #define __HANDLER_CPP__
 
-void handle_client_response(void *arg, struct tcp_pcb *tpcb, const std::string &data) {
-  const std::string client_id = get_tcp_client_id(tpcb);
+/* #region Service commands */
 
-  try {
-    json parsed_data = json::parse(data);
-    if (!parsed_data.contains("type")) {
-      printf("[Handler] Client %s sent invalid data: %s\n", client_id.c_str(), data.c_str());
-      return;
+typedef struct SERVICE_REPLY_T_ {
+  uint32_t token = 0;
+  PEER_T peer;
+  std::string id;
+} SERVICE_REPLY_T;
+
+// The SET packets waiting for their command to be applied on core 1
+static SERVICE_REPLY_T service_replies[SERVICE_COMMAND_QUEUE_SIZE];
+
+/**
+ * A TCP client keeps a send queue entry for every reply it's waiting for,
+ * so the pipelined packets it sends after a SET can't take its room
+ */
+static void handle_reserve_reply(PEER_T *peer, const bool &reserve) {
+  if (peer->udp_pcb != NULL || !peer_refresh(peer)) {
+    return;
+  }
+
+  if (reserve) {
+    peer->client->send_reserved++;
+  } else if (peer->client->send_reserved > 0) {
+    peer->client->send_reserved--;
+  }
+}
+
+/**
+ * Queues the command of a SET packet, the reply is sent once it's applied.
+ * Returns the token of the command or 0 if there are too many commands waiting.
+ */
+static uint32_t handle_set_packet(const PEER_T *peer, const std::string &packet_id, const json &body) {
+  for (uint8_t i = 0; i < SERVICE_COMMAND_QUEUE_SIZE; i++) {
+    if (service_replies[i].token != 0) {
+      continue;
     }
 
-    TCP_SERVER_T *state = static_cast<TCP_SERVER_T*>(arg);
-    const int client_index = index_of_tcp_client(state, client_id);
+    const uint32_t token = service_submit_command(body);
+    if (token == 0) {
+      return 0;
+    }
 
-    if (!parsed_data["type"].is_string()) {
-      printf("[Handler] Client %s sent invalid data: %s\n", client_id.c_str(), data.c_str());
-      return;
+    service_replies[i].token = token;
+    service_replies[i].peer = *peer;
+    service_replies[i].id = packet_id;
+    handle_reserve_reply(&service_replies[i].peer, true);
+    return token;
+  }
+
+  return 0;
+}
+
+/**
+ * The port of the idempotency key, a TCP client retries from a new connection
+ * with a new port so only the UDP datagrams are told apart by their port
+ */
+static u16_t handle_idempotency_port(const PEER_T *peer) {
+  return peer->udp_pcb != NULL ? peer->port : 0;
+}
+
+/**
+ * Answers a retried SET packet from the idempotency cache, returns false if
+ * the packet id is not in the cache and the command has to be queued.
+ */
+static bool handle_set_retry(const PEER_T *peer, const std::string &packet_id) {
+  IDEMPOTENCY_ENTRY_T *entry = idempotency_cache_find(&peer->addr, handle_idempotency_port(peer), packet_id);
+  if (entry == NULL) {
+    return false;
+  }
+
+  printf("[Handler] Retried SET %s from %s\n", packet_id.c_str(), peer->id);
+
+  // The reply of the queued command goes to the connection of the retry
+  if (entry->state == IDEMPOTENCY_STATE::PENDING) {
+    for (uint8_t i = 0; i < SERVICE_COMMAND_QUEUE_SIZE; i++) {
+      if (service_replies[i].token == entry->token) {
+        handle_reserve_reply(&service_replies[i].peer, false);
+        service_replies[i].peer = *peer;
+        handle_reserve_reply(&service_replies[i].peer, true);
+      }
+    }
+
+    return true;
+  }
+
+  TCP_SEND_ENTRY_T frame;
+  frame.data = std::make_shared<std::string>((const char*)entry->frame, entry->len);
+  frame.len = entry->len;
+
+  peer_send_frame(peer, frame);
+  return true;
+}
+
+/**
+ * Called from the service commands worker on core 0, replies to the
+ * SET packets whose command was applied by the service.
+ */
+void handle_service_completions() {
+  uint32_t token = 0;
+
+  cyw43_arch_lwip_begin();
+
+  while (service_commands.complete(token)) {
+    for (uint8_t i = 0; i < SERVICE_COMMAND_QUEUE_SIZE; i++) {
+      SERVICE_REPLY_T *reply = &service_replies[i];
+      if (reply->token != token) {
+        continue;
+      }
+
+      reply->token = 0;
+      handle_reserve_reply(&reply->peer, false);
+
+      TCP_SEND_ENTRY_T frame;
+
+      try {
+        json packet = {
+          {"id", reply->id},
+          {"client_id", reply->peer.id},
+          {"type", PACKET_TYPES(PACKET_TYPE::SET)},
+          {"data", service_get_data()}
+        };
+
+        if (build_frame(&frame, packet)) {
+          // The reply is cached even if the client disconnected, it will retry
+          idempotency_cache_complete(token, tcp_send_entry_frame(&frame), frame.len);
+
+          if (peer_refresh(&reply->peer)) {
+            peer_send_frame(&reply->peer, frame);
+          }
+        } else {
+          idempotency_cache_complete(token, NULL, 0);
+        }
+      } catch (...) {
+        printf("[Handler] Failed to reply to %s\n", reply->peer.id);
+        idempotency_cache_complete(token, NULL, 0);
+      }
+
+      buffer_pool_release(frame.buffer);
+
+      break;
+    }
+  }
+
+  cyw43_arch_lwip_end();
+}
+
+/* #endregion */
+
+/**
+ * Replaces the field subscriptions of the client on a topic (`state` by default), the client
+ * then gets DELTA packets with only the fields that changed by at least the `threshold`
+ * instead of the full packets. An empty `fields` list restores the full packets.
+ *
+ * Returns the current values of the fields.
+ */
+json handle_subscribe_packet(TCP_CLIENT_T *client, const json &body) {
+  const EventTopic *topic = event_bus_find(body.value("topic", std::string("state")));
+  if (topic == nullptr || topic->fields_count == 0) {
+    throw std::invalid_argument("Unknown topic");
+  }
+
+  const json fields = body.value("fields", json::array());
+  if (!fields.is_array()) {
+    throw std::invalid_argument("Invalid fields");
+  }
+
+  const float threshold = std::max(body.value("threshold", 0.0f), 0.0f);
+
+  FIELD_SUBSCRIPTION_T subscriptions[EVENT_BUS_MAX_FIELD_SUBSCRIPTIONS];
+  uint8_t count = 0;
+
+  // The subscriptions to the other topics are kept
+  for (uint8_t i = 0; i < client->field_subscriptions_count; i++) {
+    if (client->field_subscriptions[i].topic != topic->id) {
+      subscriptions[count++] = client->field_subscriptions[i];
+    }
+  }
+
+  const json &latest = event_bus_latest[topic->id];
+  json data = json::object();
+
+  for (const json &field : fields) {
+    const int8_t index = field.is_string() ? topic->field_index(field.get<std::string>()) : -1;
+    if (index < 0) {
+      throw std::invalid_argument("Unknown field");
+    }
+
+    if (count >= EVENT_BUS_MAX_FIELD_SUBSCRIPTIONS) {
+      throw std::invalid_argument("Too many fields");
     }
 
-    const std::string s_type = parsed_data["type"].get<std::string>();
+    FIELD_SUBSCRIPTION_T subscription = { topic->id, (uint8_t)index, threshold, 0, false };
+
+    // The thresholds start from the values sent in the reply
+    if (latest.contains("data") && latest["data"].contains(topic->fields[index])) {
+      const json &value = latest["data"][topic->fields[index]];
+      data[topic->fields[index]] = value;
+
+      if (value.is_number() || value.is_boolean()) {
+        subscription.last = value.is_boolean() ? (value.get<bool>() ? 1 : 0) : value.get<double>();
+        subscription.has_last = true;
+      }
+    }
+
+    subscriptions[count++] = subscription;
+  }
+
+  std::copy_n(subscriptions, count, client->field_subscriptions);
+  client->field_subscriptions_count = count;
+
+  if (body.contains("interval_ms") && body["interval_ms"].is_number_unsigned()) {
+    client->event_interval_ms = std::min(body["interval_ms"].get<uint32_t>(), (uint32_t)UINT16_MAX);
+  }
+
+  const uint32_t bit = 1u << topic->id;
+  if (fields.empty()) {
+    client->event_topics |= bit;
+    client->event_delta_topics &= ~bit;
+  } else {
+    client->event_topics &= ~bit;
+    client->event_delta_topics |= bit;
+  }
+
+  return data;
+}
+
+void handle_client_packet(const PEER_T *peer, const std::string &s_type, const std::string &packet_id, const json &body) {
+  const char *client_id = peer->id;
+  TCP_CLIENT_T *client = peer->client;
+
+  try {
     const PACKET_TYPE type = packet_type_from_string(s_type);
 
     if (type == PACKET_TYPE::UNKNOWN) {
-      printf("[Handler] Client %s sent invalid data: %s\n", client_id.c_str(), data.c_str());
+      printf("[Handler] Client %s sent an unknown packet type: %s\n", client_id, s_type.c_str());
       return;
     }
 
-    const u_int64_t now = get_datetime_ms();
-    (state->clients[client_index]).second->last_ping = now;
-
-    std::string packet_id = "";
-    if (parsed_data.contains("id") && parsed_data["id"].is_string()) {
-      packet_id = parsed_data["id"].get<std::string>();
+    if (client != NULL) {
+      client->last_ping = clock_ms();
     }
 
     json packet = {
@@ -58,11 +271,11 @@ void handle_client_response(void *arg, struct tcp_pcb *tpcb, const std::string &
 
     switch (type) {
       case PACKET_TYPE::PING: {
-        tcp_server_send_data(arg, tpcb, packet.dump());
+        peer_send_data(peer, packet);
         return;
       }
       case PACKET_TYPE::INFO: {
-        printf("[Handler] Sending INFO Packet to %s\n", client_id.c_str());
+        printf("[Handler] Sending INFO Packet to %s\n", client_id);
         char country_code[2] = {COUNTRY_CODE_0, COUNTRY_CODE_1};
         packet["data"] = {
           {"watchdog_enable_reboot", watchdog_enable_caused_reboot()},
@@ -72,31 +285,142 @@ void handle_client_response(void *arg, struct tcp_pcb *tpcb, const std::string &
           {"firmware_version", FIRMWARE_VERSION},
           {"serial_number", __flash_uid_s},
           {"type", SERVICE_TYPE},
-          {"ssid", WIFI_SSID}
+          {"ssid", WIFI_SSID},
+          {"clients", tcp_server_clients_count(peer->server)},
+          {"max_clients", TCP_SERVER_MAX_CLIENTS},
+          {"buffer_pool_size", TCP_SERVER_BUFFER_POOL_SIZE},
+          {"buffer_pool_free", buffer_pool_free()}
         };
-        printf("[Handler] INFO Packet prepared for %s\n", client_id.c_str());
-        tcp_server_send_data(arg, tpcb, packet.dump());
-        printf("[Handler] INFO Packet sent to %s\n", client_id.c_str());
+
+        if (client != NULL) {
+          packet["data"]["send_queue"] = {
+            {"size", TCP_SERVER_SEND_QUEUE_SIZE},
+            {"depth", client->send_count},
+            {"max_depth", client->send_max_depth},
+            {"dropped", client->send_dropped}
+          };
+        }
+
+        printf("[Handler] INFO Packet prepared for %s\n", client_id);
+        peer_send_data(peer, packet);
+        printf("[Handler] INFO Packet sent to %s\n", client_id);
+        return;
+      }
+      case PACKET_TYPE::SUBSCRIBE: {
+        // The events are only pushed on the TCP connections
+        if (client == NULL) {
+          peer_send_data(peer, create_error_packet(client_id, "Not supported over UDP"));
+          return;
+        }
+
+        try {
+          packet["data"] = handle_subscribe_packet(client, body);
+        } catch (const std::invalid_argument &e) {
+          peer_send_data(peer, create_error_packet(client_id, e.what()));
+          return;
+        }
+
+        peer_send_data(peer, packet);
+        return;
+      }
+      case PACKET_TYPE::GET: {
+        packet["data"] = service_get_data();
+        peer_send_data(peer, packet);
+        return;
+      }
+      case PACKET_TYPE::SET: {
+        if (!service.is_ready()) {
+          packet["data"] = json();
+          peer_send_data(peer, packet);
+          return;
+        }
+
+        if (handle_set_retry(peer, packet_id)) {
+          return;
+        }
+
+        const uint32_t token = handle_set_packet(peer, packet_id, body);
+        if (token == 0) {
+          peer_send_data(peer, create_error_packet(client_id, "Too many commands"));
+          return;
+        }
+
+        idempotency_cache_insert(&peer->addr, handle_idempotency_port(peer), packet_id, token);
         return;
       }
       default:
         break;
     }
 
-    json body = {};
+    packet["data"] = json();
+    peer_send_data(peer, packet);
+  } catch (...) {
+    printf("[Handler] Failed to handle packet from %s\n", client_id);
+
+    try {
+      peer_send_data(peer, create_error_packet(client_id, "Failed to handle packet"));
+    } catch (...) {}
+  }
+}
+
+/**
+ * Reads the type, id and body of the decrypted data, returns false when
+ * it isn't a valid packet (the client gets an error if it isn't JSON)
+ */
+bool handle_parse_packet(const PEER_T *peer, const std::string_view &data, std::string &s_type, std::string &packet_id, json &body) {
+  try {
+    json parsed_data = json::parse(data);
+    if (!parsed_data.contains("type") || !parsed_data["type"].is_string()) {
+      printf("[Handler] Client %s sent invalid data: %.*s\n", peer->id, (int)data.size(), data.data());
+      return false;
+    }
+
+    s_type = parsed_data["type"].get<std::string>();
+
+    if (parsed_data.contains("id") && parsed_data["id"].is_string()) {
+      packet_id = parsed_data["id"].get<std::string>();
+    }
+
     if (parsed_data.contains("body")) {
       body = parsed_data["body"];
     }
-
-    packet["data"] = service_handle_packet(body, type);
-    tcp_server_send_data(arg, tpcb, packet.dump());
   } catch (...) {
-    printf("[Handler] Failed to parse data from %s\n", client_id.c_str());
+    printf("[Handler] Failed to parse data from %s\n", peer->id);
 
     try {
-      tcp_server_send_data(arg, tpcb, create_error_packet(client_id, "Failed to parse data"));
+      peer_send_data(peer, create_error_packet(peer->id, "Failed to parse data"));
     } catch (...) {}
+    return false;
+  }
+
+  return true;
+}
+
+void handle_client_response(const PEER_T *peer, const std::string_view &data) {
+  std::string packet_id = "";
+  std::string s_type = "";
+  json body = {};
+
+  if (handle_parse_packet(peer, data, s_type, packet_id, body)) {
+    handle_client_packet(peer, s_type, packet_id, body);
   }
 }
 
+/**
+ * Decrypts the data of a frame and handles the packet
+ */
+void handle_client_frame(const PEER_T *peer, const std::string_view &frame) {
+#ifdef AES_ENCRYPTION_KEY
+  printf("[Handler] Decrypting packet from %s\n", peer->id);
+  const std::string decrypted = decrypt_256_aes_ctr(frame);
+  printf("[Handler] Packet decrypted from %s (%s)\n", peer->id, decrypted.c_str());
+
+  if (decrypted != "") {
+    handle_client_response(peer, decrypted);
+  }
+#else
+  handle_client_response(peer, frame);
+#endif
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "lwip/ip_addr.h"
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "./config.h"
+#include "./clock.cpp"
+
+#ifndef __IDEMPOTENCY_CACHE_CPP__
+#define __IDEMPOTENCY_CACHE_CPP__
+
+#ifndef IDEMPOTENCY_CACHE_SIZE
+#define IDEMPOTENCY_CACHE_SIZE 8
+#endif
+
+#ifndef IDEMPOTENCY_CACHE_FRAME_SIZE
+#define IDEMPOTENCY_CACHE_FRAME_SIZE 384
+#endif
+
+#ifndef IDEMPOTENCY_CACHE_TTL_MS
+#define IDEMPOTENCY_CACHE_TTL_MS 60000
+#endif
+
+// Longer ids are not cached, a UUID (36 characters) fits
+#define IDEMPOTENCY_CACHE_ID_SIZE 40
+
+enum class IDEMPOTENCY_STATE {
+  FREE,
+  // The command was queued and the reply is not built yet
+  PENDING,
+  DONE
+};
+
+/**
+ * The reply to a SET packet, the key is the remote address and the packet id
+ * so a retry from a new connection after a Wi-Fi drop is still matched. The
+ * `port` is only part of the key for UDP, it's 0 for TCP since a reconnected
+ * client has a new port. The ids have to be globally unique (e.g. UUIDs) so
+ * the clients behind the same address (e.g. a NAT) don't share the entries.
+ */
+typedef struct IDEMPOTENCY_ENTRY_T_ {
+  IDEMPOTENCY_STATE state = IDEMPOTENCY_STATE::FREE;
+  ip_addr_t addr;
+  u16_t port = 0;
+  char id[IDEMPOTENCY_CACHE_ID_SIZE];
+  // The command token while the entry is pending
+  uint32_t token = 0;
+  uint32_t last_used = 0;
+  // When the reply was stored, it's dropped after IDEMPOTENCY_CACHE_TTL_MS
+  uint64_t completed_ms = 0;
+  uint16_t len = 0;
+  uint8_t frame[IDEMPOTENCY_CACHE_FRAME_SIZE];
+} IDEMPOTENCY_ENTRY_T;
+
+/**
+ * Least recently used cache of the last IDEMPOTENCY_CACHE_SIZE replies,
+ * the frames are stored as they were sent so a retry is answered without
+ * running the command or serializing the reply again.
+ */
+typedef struct IDEMPOTENCY_CACHE_T_ {
+  IDEMPOTENCY_ENTRY_T entries[IDEMPOTENCY_CACHE_SIZE];
+  uint32_t uses = 0;
+} IDEMPOTENCY_CACHE_T;
+
+static IDEMPOTENCY_CACHE_T idempotency_cache;
+
+/**
+ * Frees the replies stored more than IDEMPOTENCY_CACHE_TTL_MS ago
+ */
+static void idempotency_cache_expire() {
+  const uint64_t now = clock_ms();
+
+  for (uint8_t i = 0; i < IDEMPOTENCY_CACHE_SIZE; i++) {
+    IDEMPOTENCY_ENTRY_T *entry = &idempotency_cache.entries[i];
+
+    if (entry->state == IDEMPOTENCY_STATE::DONE && now - entry->completed_ms >= IDEMPOTENCY_CACHE_TTL_MS) {
+      entry->state = IDEMPOTENCY_STATE::FREE;
+    }
+  }
+}
+
+IDEMPOTENCY_ENTRY_T* idempotency_cache_find(const ip_addr_t *addr, const u16_t &port, const std::string &id) {
+  if (id.empty() || id.size() >= IDEMPOTENCY_CACHE_ID_SIZE) {
+    return NULL;
+  }
+
+  idempotency_cache_expire();
+
+  for (uint8_t i = 0; i < IDEMPOTENCY_CACHE_SIZE; i++) {
+    IDEMPOTENCY_ENTRY_T *entry = &idempotency_cache.entries[i];
+
+    if (entry->state != IDEMPOTENCY_STATE::FREE && ip_addr_cmp(&entry->addr, addr) && entry->port == port && id == entry->id) {
+      entry->last_used = ++idempotency_cache.uses;
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Adds a pending entry for a queued command, the least recently used reply
+ * is evicted. Returns NULL if the id can't be cached or all the entries are pending.
+ */
+IDEMPOTENCY_ENTRY_T* idempotency_cache_insert(const ip_addr_t *addr, const u16_t &port, const std::string &id, const uint32_t &token) {
+  if (id.empty() || id.size() >= IDEMPOTENCY_CACHE_ID_SIZE) {
+    return NULL;
+  }
+
+  idempotency_cache_expire();
+
+  IDEMPOTENCY_ENTRY_T *entry = NULL;
+
+  for (uint8_t i = 0; i < IDEMPOTENCY_CACHE_SIZE; i++) {
+    IDEMPOTENCY_ENTRY_T *candidate = &idempotency_cache.entries[i];
+
+    if (candidate->state == IDEMPOTENCY_STATE::FREE) {
+      entry = candidate;
+      break;
+    }
+
+    if (candidate->state == IDEMPOTENCY_STATE::DONE && (entry == NULL || candidate->last_used < entry->last_used)) {
+      entry = candidate;
+    }
+  }
+
+  if (entry == NULL) {
+    return NULL;
+  }
+
+  entry->state = IDEMPOTENCY_STATE::PENDING;
+  ip_addr_copy(entry->addr, *addr);
+  entry->port = port;
+  memcpy(entry->id, id.c_str(), id.size() + 1);
+  entry->token = token;
+  entry->last_used = ++idempotency_cache.uses;
+  entry->len = 0;
+
+  return entry;
+}
+
+/**
+ * Stores the reply of a completed command, a reply larger than
+ * IDEMPOTENCY_CACHE_FRAME_SIZE frees the entry instead.
+ */
+void idempotency_cache_complete(const uint32_t &token, const uint8_t *frame, const uint16_t &len) {
+  for (uint8_t i = 0; i < IDEMPOTENCY_CACHE_SIZE; i++) {
+    IDEMPOTENCY_ENTRY_T *entry = &idempotency_cache.entries[i];
+    if (entry->state != IDEMPOTENCY_STATE::PENDING || entry->token != token) {
+      continue;
+    }
+
+    if (frame == NULL || len > IDEMPOTENCY_CACHE_FRAME_SIZE) {
+      entry->state = IDEMPOTENCY_STATE::FREE;
+      return;
+    }
+
+    memcpy(entry->frame, frame, len);
+    entry->len = len;
+    entry->token = 0;
+    entry->completed_ms = clock_ms();
+    entry->state = IDEMPOTENCY_STATE::DONE;
+    return;
+  }
+}
+
+#endif
@@ -0,0 +1,467 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+#ifndef INCLUDE_NLOHMANN_JSON_HPP_
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+#endif
+
+#ifndef __JSON_STREAM_CPP__
+#define __JSON_STREAM_CPP__
+
+#define JSON_STREAM_MAX_DEPTH 16
+
+#ifndef JSON_STREAM_MAX_TOKEN
+#define JSON_STREAM_MAX_TOKEN 512
+#endif
+
+/**
+ * Push parser for JSON, the input can be written in any chunking and
+ * the values are reported as SAX events while the bytes arrive.
+ *
+ * Only one string or number is held at a time, so the memory used by the
+ * parser doesn't depend on the size of the document. A string (after the
+ * escapes are decoded) or a number longer than JSON_STREAM_MAX_TOKEN bytes
+ * is an error, it isn't split in several events.
+ */
+class JsonStream {
+  private:
+    enum class STATE {
+      VALUE,
+      FIRST_VALUE,
+      AFTER_VALUE,
+      KEY,
+      FIRST_KEY,
+      COLON,
+      STRING,
+      STRING_ESCAPE,
+      STRING_UNICODE,
+      NUMBER,
+      LITERAL,
+      DONE,
+      ERROR
+    };
+
+    nlohmann::json_sax<json> *sax = nullptr;
+    STATE state = STATE::ERROR;
+
+    // '{' or '[' for every open container
+    char stack[JSON_STREAM_MAX_DEPTH];
+    uint8_t depth = 0;
+
+    std::string token;
+    bool token_is_key = false;
+    bool token_is_float = false;
+
+    const char *literal = nullptr;
+    uint8_t literal_posn = 0;
+
+    uint32_t unicode = 0;
+    uint32_t high_surrogate = 0;
+    uint8_t unicode_digits = 0;
+
+    bool fail() {
+      this->state = STATE::ERROR;
+      return false;
+    }
+
+    bool is_whitespace(const char &c) {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    /**
+     * Checks the number grammar of JSON, strtod and strtoull also accept
+     * leading zeros and a fraction or an exponent without digits
+     */
+    bool valid_number() {
+      const std::string &value = this->token;
+      size_t i = value[0] == '-' ? 1 : 0;
+
+      if (i < value.size() && value[i] == '0') {
+        i++;
+      } else if (i < value.size() && value[i] >= '1' && value[i] <= '9') {
+        while (i < value.size() && value[i] >= '0' && value[i] <= '9') i++;
+      } else {
+        return false;
+      }
+
+      if (i < value.size() && value[i] == '.') {
+        const size_t digits = ++i;
+        while (i < value.size() && value[i] >= '0' && value[i] <= '9') i++;
+        if (i == digits) {
+          return false;
+        }
+      }
+
+      if (i < value.size() && (value[i] == 'e' || value[i] == 'E')) {
+        if (++i < value.size() && (value[i] == '+' || value[i] == '-')) {
+          i++;
+        }
+
+        const size_t digits = i;
+        while (i < value.size() && value[i] >= '0' && value[i] <= '9') i++;
+        if (i == digits) {
+          return false;
+        }
+      }
+
+      return i == value.size();
+    }
+
+    void value_done() {
+      this->state = this->depth == 0 ? STATE::DONE : STATE::AFTER_VALUE;
+    }
+
+    void append_utf8(const uint32_t &cp) {
+      if (cp < 0x80) {
+        this->token.push_back(static_cast<char>(cp));
+      } else if (cp < 0x800) {
+        this->token.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        this->token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+      } else if (cp < 0x10000) {
+        this->token.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        this->token.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        this->token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+      } else {
+        this->token.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        this->token.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        this->token.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        this->token.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+      }
+    }
+
+    bool open(const char &c) {
+      if (this->depth >= JSON_STREAM_MAX_DEPTH) {
+        return this->fail();
+      }
+
+      this->stack[this->depth++] = c;
+
+      if (c == '{') {
+        this->state = STATE::FIRST_KEY;
+        return this->sax->start_object(static_cast<std::size_t>(-1)) || this->fail();
+      }
+
+      this->state = STATE::FIRST_VALUE;
+      return this->sax->start_array(static_cast<std::size_t>(-1)) || this->fail();
+    }
+
+    bool close(const char &c) {
+      if (this->depth == 0 || this->stack[this->depth - 1] != (c == '}' ? '{' : '[')) {
+        return this->fail();
+      }
+
+      this->depth--;
+      this->value_done();
+
+      if (c == '}') {
+        return this->sax->end_object() || this->fail();
+      }
+
+      return this->sax->end_array() || this->fail();
+    }
+
+    bool end_string() {
+      if (this->high_surrogate != 0) {
+        return this->fail();
+      }
+
+      if (this->token_is_key) {
+        this->state = STATE::COLON;
+        return this->sax->key(this->token) || this->fail();
+      }
+
+      this->value_done();
+      return this->sax->string(this->token) || this->fail();
+    }
+
+    bool end_number() {
+      const char *begin = this->token.c_str();
+      char *end = nullptr;
+      bool result = false;
+
+      this->value_done();
+
+      if (!this->valid_number()) {
+        return this->fail();
+      }
+
+      if (this->token_is_float) {
+        const double value = strtod(begin, &end);
+        result = end == begin + this->token.size() && this->sax->number_float(value, this->token);
+      } else if (this->token[0] == '-') {
+        const long long value = strtoll(begin, &end, 10);
+        result = end == begin + this->token.size() && this->sax->number_integer(value);
+      } else {
+        const unsigned long long value = strtoull(begin, &end, 10);
+        result = end == begin + this->token.size() && this->sax->number_unsigned(value);
+      }
+
+      return result || this->fail();
+    }
+
+    bool end_literal() {
+      this->value_done();
+
+      switch (this->literal[0]) {
+        case 't':
+          return this->sax->boolean(true) || this->fail();
+        case 'f':
+          return this->sax->boolean(false) || this->fail();
+        default:
+          return this->sax->null() || this->fail();
+      }
+    }
+
+    bool begin_value(const char &c) {
+      switch (c) {
+        case '{':
+        case '[':
+          return this->open(c);
+        case '"':
+          this->token.clear();
+          this->token_is_key = false;
+          this->state = STATE::STRING;
+          return true;
+        case 't':
+          this->literal = "true";
+          break;
+        case 'f':
+          this->literal = "false";
+          break;
+        case 'n':
+          this->literal = "null";
+          break;
+        default:
+          if (c == '-' || (c >= '0' && c <= '9')) {
+            this->token.clear();
+            this->token.push_back(c);
+            this->token_is_float = false;
+            this->state = STATE::NUMBER;
+            return true;
+          }
+
+          return this->fail();
+      }
+
+      this->literal_posn = 1;
+      this->state = STATE::LITERAL;
+      return true;
+    }
+
+    bool push(const char &c) {
+      switch (this->state) {
+        case STATE::FIRST_VALUE:
+          if (c == ']') {
+            return this->close(c);
+          }
+          // fall through
+        case STATE::VALUE:
+          if (this->is_whitespace(c)) {
+            return true;
+          }
+
+          return this->begin_value(c);
+        case STATE::FIRST_KEY:
+          if (c == '}') {
+            return this->close(c);
+          }
+          // fall through
+        case STATE::KEY:
+          if (this->is_whitespace(c)) {
+            return true;
+          }
+
+          if (c != '"') {
+            return this->fail();
+          }
+
+          this->token.clear();
+          this->token_is_key = true;
+          this->state = STATE::STRING;
+          return true;
+        case STATE::COLON:
+          if (this->is_whitespace(c)) {
+            return true;
+          }
+
+          if (c != ':') {
+            return this->fail();
+          }
+
+          this->state = STATE::VALUE;
+          return true;
+        case STATE::AFTER_VALUE:
+          if (this->is_whitespace(c)) {
+            return true;
+          }
+
+          if (c == ',') {
+            this->state = this->stack[this->depth - 1] == '{' ? STATE::KEY : STATE::VALUE;
+            return true;
+          }
+
+          if (c == '}' || c == ']') {
+            return this->close(c);
+          }
+
+          return this->fail();
+        case STATE::STRING:
+          if (c == '"') {
+            return this->end_string();
+          }
+
+          if (c == '\\') {
+            this->state = STATE::STRING_ESCAPE;
+            return true;
+          }
+
+          if (static_cast<uint8_t>(c) < 0x20 || this->high_surrogate != 0 || this->token.size() >= JSON_STREAM_MAX_TOKEN) {
+            return this->fail();
+          }
+
+          this->token.push_back(c);
+          return true;
+        case STATE::STRING_ESCAPE: {
+          char escaped = 0;
+          switch (c) {
+            case '"': escaped = '"'; break;
+            case '\\': escaped = '\\'; break;
+            case '/': escaped = '/'; break;
+            case 'b': escaped = '\b'; break;
+            case 'f': escaped = '\f'; break;
+            case 'n': escaped = '\n'; break;
+            case 'r': escaped = '\r'; break;
+            case 't': escaped = '\t'; break;
+            case 'u':
+              this->unicode = 0;
+              this->unicode_digits = 0;
+              this->state = STATE::STRING_UNICODE;
+              return true;
+            default:
+              return this->fail();
+          }
+
+          if (this->high_surrogate != 0 || this->token.size() >= JSON_STREAM_MAX_TOKEN) {
+            return this->fail();
+          }
+
+          this->token.push_back(escaped);
+          this->state = STATE::STRING;
+          return true;
+        }
+        case STATE::STRING_UNICODE: {
+          uint8_t digit = 0;
+          if (c >= '0' && c <= '9') {
+            digit = c - '0';
+          } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+          } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+          } else {
+            return this->fail();
+          }
+
+          this->unicode = (this->unicode << 4) | digit;
+          if (++this->unicode_digits < 4) {
+            return true;
+          }
+
+          this->state = STATE::STRING;
+
+          if (this->unicode >= 0xD800 && this->unicode <= 0xDBFF) {
+            if (this->high_surrogate != 0) {
+              return this->fail();
+            }
+
+            this->high_surrogate = this->unicode;
+            return true;
+          }
+
+          uint32_t cp = this->unicode;
+          if (cp >= 0xDC00 && cp <= 0xDFFF) {
+            if (this->high_surrogate == 0) {
+              return this->fail();
+            }
+
+            cp = 0x10000 + ((this->high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+            this->high_surrogate = 0;
+          } else if (this->high_surrogate != 0) {
+            return this->fail();
+          }
+
+          if (this->token.size() + (cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4) > JSON_STREAM_MAX_TOKEN) {
+            return this->fail();
+          }
+
+          this->append_utf8(cp);
+          return true;
+        }
+        case STATE::NUMBER:
+          if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+            if (this->token.size() >= JSON_STREAM_MAX_TOKEN) {
+              return this->fail();
+            }
+
+            this->token_is_float = this->token_is_float || c == '.' || c == 'e' || c == 'E';
+            this->token.push_back(c);
+            return true;
+          }
+
+          // The number ends at the first character that can't be part of it
+          return this->end_number() && this->push(c);
+        case STATE::LITERAL:
+          if (c != this->literal[this->literal_posn]) {
+            return this->fail();
+          }
+
+          if (this->literal[++this->literal_posn] == '\0') {
+            return this->end_literal();
+          }
+
+          return true;
+        case STATE::DONE:
+          return this->is_whitespace(c) || this->fail();
+        default:
+          return false;
+      }
+    }
+
+  public:
+    JsonStream() {
+      this->token.reserve(JSON_STREAM_MAX_TOKEN);
+    }
+
+    void reset(nlohmann::json_sax<json> *sax) {
+      this->sax = sax;
+      this->state = STATE::VALUE;
+      this->depth = 0;
+      this->token.clear();
+      this->high_surrogate = 0;
+    }
+
+    bool write(const uint8_t *data, const size_t &len) {
+      for (size_t i = 0; i < len; i++) {
+        if (!this->push(static_cast<char>(data[i]))) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    /**
+     * Returns true if exactly one complete JSON value was written
+     */
+    bool end() {
+      if (this->state == STATE::NUMBER && this->depth == 0 && !this->end_number()) {
+        return false;
+      }
+
+      return this->state == STATE::DONE;
+    }
+};
+
+#endif
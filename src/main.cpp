@@ -34,6 +34,8 @@ void core1_entry() {
   service.ready();
 
   while (true) {
+    service_run_commands();
+
     #ifdef __HAS_LOOP
       service.loop();
     #else
@@ -21,6 +21,8 @@
 #include "lwip/pbuf.h"
 #include "lwip/udp.h"
 
+#include "./clock.cpp"
+
 #ifndef __NTP_CPP__
 #define __NTP_CPP__
 
@@ -131,6 +133,13 @@ static void ntp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_ad
     uint32_t seconds_since_1900 = seconds_buf[0] << 24 | seconds_buf[1] << 16 | seconds_buf[2] << 8 | seconds_buf[3];
     uint32_t seconds_since_1970 = seconds_since_1900 - NTP_DELTA;
     time_t epoch = seconds_since_1970;
+
+    uint8_t fraction_buf[4] = {0};
+    pbuf_copy_partial(p, fraction_buf, sizeof(fraction_buf), 44);
+    uint32_t fraction = fraction_buf[0] << 24 | fraction_buf[1] << 16 | fraction_buf[2] << 8 | fraction_buf[3];
+
+    // The offset to the monotonic clock is captured once, reading the time is then a single add
+    clock_set_epoch_us((uint64_t)seconds_since_1970 * 1000000 + (((uint64_t)fraction * 1000000) >> 32));
     ntp_result(state, 0, &epoch);
   } else {
     printf("[NTP] Invalid response\n");
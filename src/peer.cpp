@@ -0,0 +1,92 @@
+#include "lwip/ip_addr.h"
+#include "lwip/udp.h"
+#include <stdio.h>
+
+#include "./config.h"
+#include "./server-utils.cpp"
+#include "./sender.cpp"
+
+#ifndef INCLUDE_NLOHMANN_JSON_HPP_
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+#endif
+
+#ifndef __PEER_CPP__
+#define __PEER_CPP__
+
+/**
+ * The sender of a packet, either a TCP client or the address of a UDP
+ * datagram, the handlers reply to it without knowing the transport.
+ */
+typedef struct PEER_T_ {
+  TCP_SERVER_T *server = NULL;
+  // NULL for a UDP peer
+  TCP_CLIENT_T *client = NULL;
+  TCP_CLIENT_HANDLE handle = 0;
+
+  // NULL for a TCP peer
+  struct udp_pcb *udp_pcb = NULL;
+  // The remote address for both transports
+  ip_addr_t addr;
+  u16_t port = 0;
+
+  char id[TCP_CLIENT_ID_SIZE] = "";
+} PEER_T;
+
+PEER_T peer_from_tcp_client(TCP_CLIENT_T *client) {
+  PEER_T peer;
+  peer.server = client->server;
+  peer.client = client;
+  peer.handle = tcp_client_handle(client);
+  ip_addr_copy(peer.addr, client->client_pcb->remote_ip);
+  peer.port = client->client_pcb->remote_port;
+  snprintf(peer.id, TCP_CLIENT_ID_SIZE, "%s", tcp_client_id(client));
+
+  return peer;
+}
+
+PEER_T peer_from_udp(TCP_SERVER_T *server, struct udp_pcb *pcb, const ip_addr_t *addr, const u16_t &port) {
+  PEER_T peer;
+  peer.server = server;
+  peer.udp_pcb = pcb;
+  ip_addr_copy(peer.addr, *addr);
+  peer.port = port;
+  snprintf(peer.id, TCP_CLIENT_ID_SIZE, "%s:%u", ipaddr_ntoa(addr), port);
+
+  return peer;
+}
+
+/**
+ * A TCP peer is only valid while the same client is connected, returns
+ * false if it disconnected (e.g. while its reply was waiting).
+ */
+bool peer_refresh(PEER_T *peer) {
+  if (peer->udp_pcb != NULL) {
+    return true;
+  }
+
+  peer->client = tcp_client_from_handle(peer->server, peer->handle);
+  return peer->client != NULL;
+}
+
+err_t peer_send_data(const PEER_T *peer, const json &packet) {
+  if (peer->client != NULL) {
+    return tcp_server_send_data(peer->client, packet);
+  }
+
+  return udp_server_send_data(peer->udp_pcb, &peer->addr, peer->port, packet);
+}
+
+/**
+ * Sends a frame built with `build_frame`, it can be sent to several peers
+ */
+err_t peer_send_frame(const PEER_T *peer, const TCP_SEND_ENTRY_T &frame) {
+  if (peer->client != NULL) {
+    return tcp_server_queue_frame(peer->client, frame, SEND_POLICY::NEVER_DROP);
+  }
+
+  return udp_server_send_frame(peer->udp_pcb, &peer->addr, peer->port, frame);
+}
+
+#endif
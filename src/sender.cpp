@@ -3,125 +3,400 @@
 #include "pico/stdlib.h"
 #include "lwip/pbuf.h"
 #include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include <cmath>
 
 #include "./config.h"
 #include "./server-utils.cpp"
+#include "./frame-builder.cpp"
 
 #ifndef __SENDER_CPP__
 #define __SENDER_CPP__
 
-std::string create_error_packet(const std::string &client_id, const std::string &message) {
-  json packet = {
+json create_error_packet(const std::string &client_id, const std::string &message) {
+  return {
     {"type", PACKET_TYPES(PACKET_TYPE::ERROR)},
     {"client_id", client_id},
     {"message", message}
   };
+}
+
+/**
+ * Builds the frame in a pool buffer, or in the frame's own data sized
+ * to the frame when no buffer is free or the frame is larger than one.
+ */
+static bool build_frame(TCP_SEND_ENTRY_T *frame, const json &packet) {
+  try {
+    frame->buffer = buffer_pool_acquire();
+    if (frame->buffer != NULL && frame_build(packet, frame->buffer, TCP_SERVER_BUF_SIZE, &frame->offset, &frame->len)) {
+      return true;
+    }
+
+    buffer_pool_release(frame->buffer);
+    frame->buffer = NULL;
+
+    // A frame larger than the send buffer could never be written
+    const size_t capacity = frame_capacity(packet);
+    if (capacity > TCP_SND_BUF) {
+      return false;
+    }
 
-  return packet.dump();
+    frame->data = std::make_shared<std::string>(capacity, '\0');
+    return frame_build(packet, (uint8_t*)frame->data->data(), capacity, &frame->offset, &frame->len);
+  } catch (...) {
+    printf("[Sender] Failed to serialize the packet\n");
+    buffer_pool_release(frame->buffer);
+    frame->buffer = NULL;
+    frame->data.reset();
+    return false;
+  }
 }
 
-std::string parse_data_to_be_sent(const std::string &data, const std::string &client_id) {
-  std::string data_to_be_sent = data;
+/**
+ * Writes the queued frames while the send buffer has room, called again
+ * from `tcp_server_sent` as the client acknowledges the data and from
+ * `tcp_server_poll` in case nothing was in flight.
+ *
+ * lwIP copies the data (LWIP_NETIF_TX_SINGLE_PBUF forces TCP_WRITE_FLAG_COPY),
+ * so a frame and its pool buffer are released as soon as it's written.
+ */
+err_t tcp_server_flush_send_queue(TCP_CLIENT_T *client) {
+  cyw43_arch_lwip_check();
+
+  err_t err = ERR_OK;
+  bool written = false;
 
-#ifdef AES_ENCRYPTION_KEY
-  printf("[Sender] Encrypting packet for %s, Raw Packet:\n", client_id.c_str());
-  printf("%s\n", data.c_str());
-  data_to_be_sent = encrypt_256_aes_ctr(data);
-#endif
+  while (client->send_count > 0) {
+    TCP_SEND_ENTRY_T *entry = tcp_client_send_entry(client, 0);
+    if (tcp_sndbuf(client->client_pcb) < entry->len) {
+      break;
+    }
+
+    err = tcp_write(client->client_pcb, tcp_send_entry_frame(entry), entry->len, TCP_WRITE_FLAG_COPY);
+
+    if (err != ERR_OK) {
+      break;
+    }
 
-  if (data_to_be_sent == "") {
-    return "";
+    tcp_client_send_queue_pop(client);
+    written = true;
   }
 
-  int data_length = data_to_be_sent.size();
-  printf("[Sender] Data length: %d\n", data_length);
-  return std::to_string(data_length) + std::string(";") + data_to_be_sent;
+  if (written) {
+    tcp_output(client->client_pcb);
+  }
+
+  return err == ERR_MEM ? ERR_OK : err;
 }
 
-err_t tcp_server_send_data(void *arg, struct tcp_pcb *tpcb, const std::string &data) {
-  const std::string client_id = get_tcp_client_id(tpcb);
-  const std::string data_to_be_sent = parse_data_to_be_sent(data, client_id);
-  if (data_to_be_sent == "") {
-    return ERR_VAL;
+/**
+ * Queues a built frame to the client, the pool buffer or the frame's
+ * data is shared with the other clients the frame is queued to and not copied.
+ */
+static err_t tcp_server_queue_frame(TCP_CLIENT_T *client, const TCP_SEND_ENTRY_T &frame, const SEND_POLICY &policy) {
+  const char *client_id = tcp_client_id(client);
+
+  TCP_SEND_ENTRY_T *entry = tcp_client_send_queue_reserve(client, policy);
+  if (entry == NULL) {
+    printf("[Sender] Send queue full for %s, dropping the packet\n", client_id);
+    return ERR_MEM;
   }
 
-  if (data_to_be_sent.size() > TCP_SERVER_BUF_SIZE) {
-    printf("[Sender] Data too large to send\n");
-    return ERR_VAL;
+  if (frame.buffer == NULL) {
+    entry->data = frame.data;
+    entry->offset = frame.offset;
+  } else if (buffer_pool_retain(frame.buffer)) {
+    entry->buffer = frame.buffer;
+    entry->offset = frame.offset;
+  } else {
+    // The buffer reached its reference limit
+    entry->data = std::make_shared<std::string>((const char*)tcp_send_entry_frame(&frame), frame.len);
+    entry->offset = 0;
   }
 
-  TCP_SERVER_T *state = static_cast<TCP_SERVER_T*>(arg);
+  entry->len = frame.len;
+
+  tcp_client_send_queue_commit(client);
+  printf("[Sender] Queued %u bytes for client (%s), %u frames in queue\n", entry->len, client_id, client->send_count);
 
-  const int client_index = index_of_tcp_client(state, client_id);
+  const err_t err = tcp_server_flush_send_queue(client);
+  if (err != ERR_OK) {
+    printf("[Sender] Failed to write data %d (%s)\n", err, client_id);
+  }
+
+  return err;
+}
+
+err_t tcp_server_send_data(TCP_CLIENT_T *client, const json &packet, const SEND_POLICY &policy = SEND_POLICY::NEVER_DROP) {
+  if (client->client_pcb == NULL) {
+    printf("[Sender] Client %s is closed\n", tcp_client_id(client));
+    return ERR_CLSD;
+  }
 
-  if (client_index == -1) {
-    printf("[Sender] Client %s not found\n", client_id.c_str());
-    tcp_close_client(tpcb);
+  TCP_SEND_ENTRY_T frame;
+  if (!build_frame(&frame, packet)) {
+    printf("[Sender] Data too large to send\n");
     return ERR_VAL;
   }
 
-  std::shared_ptr<TCP_CLIENT_T> client = (state->clients[client_index]).second;
+  const err_t err = tcp_server_queue_frame(client, frame, policy);
+  buffer_pool_release(frame.buffer);
+
+  return err;
+}
 
-  std::fill_n(client->buffer_sent, TCP_SERVER_BUF_SIZE, 0);
+/**
+ * Sends the packet to the clients matching `filter`, the frame is built
+ * and encrypted once and every client queues the same buffer.
+ */
+template <typename Fn>
+void send_to_tcp_clients(TCP_SERVER_T *state, const json &packet, const SEND_POLICY &policy, Fn filter) {
+  cyw43_arch_lwip_begin();
 
-  for(int i = 0; i < data_to_be_sent.size(); i++) {
-    client->buffer_sent[i] = (uint8_t)data_to_be_sent[i];
+  TCP_SEND_ENTRY_T frame;
+  if (build_frame(&frame, packet)) {
+    for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+      TCP_CLIENT_T *client = &state->clients[i];
+
+      if (client->in_use && filter(client)) {
+        try {
+          tcp_server_queue_frame(client, frame, policy);
+        } catch (...) { }
+      }
+    }
+  } else {
+    printf("[Sender] Data too large to send\n");
   }
 
-  client->buffer_sent[data_to_be_sent.size()] = (uint8_t)'\0';
+  buffer_pool_release(frame.buffer);
 
-  printf("[Sender] Writing %ld bytes to client (%s)\n", data_to_be_sent.size(), client_id.c_str());
+  cyw43_arch_lwip_end();
+}
+
+void send_to_all_tcp_clients(TCP_SERVER_T *state, const json &packet) {
+  send_to_tcp_clients(state, packet, SEND_POLICY::DROP_OLDEST, [] (TCP_CLIENT_T *client) {
+    return true;
+  });
+}
 
+/**
+ * Sends a built frame as a single datagram, lwIP references the frame
+ * and copies it only if it has to hold it after udp_sendto returns.
+ */
+err_t udp_server_send_frame(struct udp_pcb *pcb, const ip_addr_t *addr, const u16_t &port, const TCP_SEND_ENTRY_T &frame) {
   cyw43_arch_lwip_check();
-  err_t err = tcp_write(tpcb, client->buffer_sent, data_to_be_sent.size(), TCP_WRITE_FLAG_COPY);
+
+  err_t err = ERR_MEM;
+  struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, frame.len, PBUF_REF);
+
+  if (p != NULL) {
+    p->payload = (void*)tcp_send_entry_frame(&frame);
+    err = udp_sendto(pcb, p, addr, port);
+    pbuf_free(p);
+  }
 
   if (err != ERR_OK) {
-    printf("[Sender] Failed to write data %d (%s)\n", err, client_id.c_str());
-    return err;
+    printf("[Sender] Failed to send the datagram %d\n", err);
   }
 
-  return ERR_OK;
+  return err;
 }
 
-void send_to_all_tcp_clients(TCP_SERVER_T *state, const std::string &data) {
-  cyw43_arch_lwip_begin();
-  for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
-    if (state->clients[i].first != "") {
-      try {
-        tcp_server_send_data(state, state->clients[i].second->client_pcb, data);
-      } catch (...) { }
+/**
+ * Sends the packet as a single datagram, the UDP clients retry
+ * the requests that get no reply.
+ */
+err_t udp_server_send_data(struct udp_pcb *pcb, const ip_addr_t *addr, const u16_t &port, const json &packet) {
+  TCP_SEND_ENTRY_T frame;
+  if (!build_frame(&frame, packet)) {
+    printf("[Sender] Data too large to send\n");
+    return ERR_VAL;
+  }
+
+  const err_t err = udp_server_send_frame(pcb, addr, port, frame);
+  buffer_pool_release(frame.buffer);
+
+  return err;
+}
+
+/* #region Event bus */
+
+// The last packet of every latest-wins topic, kept for the clients waiting for their interval
+static json event_bus_latest[EVENT_BUS_MAX_TOPICS];
+
+static json create_event_packet(const EventTopic *topic, const json &data) {
+  return {
+    {"type", PACKET_TYPES(topic->type)},
+    {"client_id", "server"},
+    {"topic", topic->name},
+    {"data", data}
+  };
+}
+
+static bool event_bus_due(const TCP_CLIENT_T *client, const uint8_t &topic, const uint32_t &now) {
+  return (client->event_pending & (1u << topic)) != 0 && (int32_t)(now - client->event_next_ms[topic]) >= 0;
+}
+
+/**
+ * Sends the subscribed fields that changed by at least their threshold since the last push
+ */
+static void send_event_delta(TCP_CLIENT_T *client, const EventTopic *topic, const json &data) {
+  json delta = json::object();
+  double values[EVENT_BUS_MAX_FIELD_SUBSCRIPTIONS];
+  uint8_t changed = 0;
+
+  for (uint8_t i = 0; i < client->field_subscriptions_count; i++) {
+    const FIELD_SUBSCRIPTION_T *subscription = &client->field_subscriptions[i];
+    if (subscription->topic != topic->id) {
+      continue;
     }
+
+    const char *name = topic->fields[subscription->field];
+    const auto value = data.find(name);
+    if (value == data.end() || !(value->is_number() || value->is_boolean())) {
+      continue;
+    }
+
+    values[i] = value->is_boolean() ? (value->get<bool>() ? 1 : 0) : value->get<double>();
+
+    if (
+      !subscription->has_last ||
+      (values[i] != subscription->last && std::fabs(values[i] - subscription->last) >= subscription->threshold)
+    ) {
+      delta[name] = *value;
+      changed |= 1u << i;
+    }
+  }
+
+  if (changed == 0) {
+    return;
   }
+
+  json packet = {
+    {"type", PACKET_TYPES(PACKET_TYPE::DELTA)},
+    {"client_id", "server"},
+    {"topic", topic->name},
+    {"data", delta}
+  };
+
+  cyw43_arch_lwip_begin();
+  const err_t err = tcp_server_send_data(client, packet);
   cyw43_arch_lwip_end();
-}
 
-uint32_t __data_last_sent_to_all_clients = 0;
-json __data_to_send_to_all_clients = {};
-bool __send_data_to_all_clients = false;
+  // The thresholds are relative to the values the client received
+  if (err != ERR_OK) {
+    return;
+  }
 
-void send_get_packet_to_all(const json &data) {
-  __data_to_send_to_all_clients = data;
-  __send_data_to_all_clients = true;
+  for (uint8_t i = 0; i < client->field_subscriptions_count; i++) {
+    if ((changed & (1u << i)) != 0) {
+      client->field_subscriptions[i].last = values[i];
+      client->field_subscriptions[i].has_last = true;
+    }
+  }
 }
 
-void sender_main_loop(TCP_SERVER_T *tcp_server_state) {
-  if (__send_data_to_all_clients) {
-    const uint32_t now = to_ms_since_boot(get_absolute_time());
+/**
+ * Called from the event bus worker on core 0, sends the values published on the
+ * topics to the subscribed clients as soon as their interval allows it.
+ *
+ * Returns the milliseconds until a client that is still waiting for its
+ * interval can get the value, or -1 if no client is waiting.
+ */
+int32_t event_bus_dispatch(TCP_SERVER_T *state) {
+  const uint32_t now = clock_ms();
 
-    // Add a timeout to prevent spamming
-    if (now - __data_last_sent_to_all_clients > 1000) {
-      __data_last_sent_to_all_clients = now;
-      __send_data_to_all_clients = false;
+  // The subscriptions are changed by the packet handlers in the lwIP context
+  cyw43_arch_lwip_begin();
+
+  for (uint8_t t = 0; t < event_bus.count; t++) {
+    EventTopic *topic = event_bus.topics[t];
+    const uint32_t bit = 1u << t;
+    json data;
 
-      json packet = {
-        {"type", PACKET_TYPES(PACKET_TYPE::GET)},
-        {"client_id", "server"},
-        {"data", __data_to_send_to_all_clients}
-      };
+    if (topic->policy == EVENT_POLICY::QUEUED) {
+      while (topic->take(data)) {
+        send_to_tcp_clients(state, create_event_packet(topic, data), SEND_POLICY::NEVER_DROP, [bit] (TCP_CLIENT_T *client) {
+          return (client->event_topics & bit) != 0;
+        });
+      }
 
-      send_to_all_tcp_clients(tcp_server_state, packet.dump());
+      continue;
+    }
+
+    if (topic->take(data)) {
+      event_bus_latest[t] = create_event_packet(topic, data);
+
+      for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+        if (state->clients[i].in_use && ((state->clients[i].event_topics | state->clients[i].event_delta_topics) & bit) != 0) {
+          state->clients[i].event_pending |= bit;
+        }
+      }
+    }
+
+    bool due = false;
+    for (int i = 0; i < TCP_SERVER_MAX_CLIENTS && !due; i++) {
+      due = state->clients[i].in_use && event_bus_due(&state->clients[i], t, now);
+    }
+
+    if (!due) {
+      continue;
+    }
+
+    send_to_tcp_clients(state, event_bus_latest[t], SEND_POLICY::DROP_OLDEST, [t, bit, now] (TCP_CLIENT_T *client) {
+      if ((client->event_topics & bit) == 0 || !event_bus_due(client, t, now)) {
+        return false;
+      }
+
+      client->event_pending &= ~bit;
+      client->event_next_ms[t] = now + client->event_interval_ms;
+      return true;
+    });
+
+    // The clients with field subscriptions get their own DELTA packet
+    for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+      TCP_CLIENT_T *client = &state->clients[i];
+
+      if (!client->in_use || (client->event_delta_topics & bit) == 0 || !event_bus_due(client, t, now)) {
+        continue;
+      }
+
+      client->event_pending &= ~bit;
+      client->event_next_ms[t] = now + client->event_interval_ms;
+
+      try {
+        send_event_delta(client, topic, event_bus_latest[t]["data"]);
+      } catch (...) { }
     }
   }
+
+  int32_t next = -1;
+  for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+    const TCP_CLIENT_T *client = &state->clients[i];
+    if (!client->in_use || client->event_pending == 0) {
+      continue;
+    }
+
+    for (uint8_t t = 0; t < event_bus.count; t++) {
+      if ((client->event_pending & (1u << t)) == 0) {
+        continue;
+      }
+
+      int32_t delay = (int32_t)(client->event_next_ms[t] - now);
+      if (delay < 0) {
+        delay = 0;
+      }
+
+      if (next < 0 || delay < next) {
+        next = delay;
+      }
+    }
+  }
+
+  cyw43_arch_lwip_end();
+  return next;
 }
 
+/* #endregion */
+
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "hardware/sync.h"
+#include <type_traits>
+#include <stdint.h>
+
+#ifndef __SEQLOCK_CPP__
+#define __SEQLOCK_CPP__
+
+/**
+ * A value written by one core and read by the other without locks: the
+ * sequence is odd while it's written and the reader retries if it changed
+ * while copying.
+ *
+ * The writer runs with the interrupts disabled, so an alarm callback can't
+ * interrupt a write from the loop on the same core, and the reader never waits
+ * longer than a copy of the value.
+ */
+template <typename T>
+class Seqlock {
+  static_assert(std::is_trivially_copyable<T>::value, "The value must be trivially copyable");
+
+  private:
+    volatile uint32_t sequence = 0;
+    T value;
+
+  public:
+    void store(const T &value) {
+      const uint32_t interrupts = save_and_disable_interrupts();
+
+      this->sequence = this->sequence + 1;
+      __dmb();
+      this->value = value;
+      __dmb();
+      this->sequence = this->sequence + 1;
+
+      restore_interrupts(interrupts);
+    }
+
+    /**
+     * Returns false if the value is being written or was never written,
+     * `sequence` is set to the version of the value read.
+     */
+    bool try_load(T &value, uint32_t &sequence) const {
+      sequence = this->sequence;
+      if ((sequence & 1) != 0 || sequence == 0) {
+        return false;
+      }
+
+      __dmb();
+      const T copy = this->value;
+      __dmb();
+
+      if (this->sequence != sequence) {
+        return false;
+      }
+
+      value = copy;
+      return true;
+    }
+
+    /**
+     * Returns false only if the value was never written
+     */
+    bool load(T &value) const {
+      uint32_t sequence = 0;
+
+      while (!this->try_load(value, sequence)) {
+        if (this->sequence == 0) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+};
+
+#endif
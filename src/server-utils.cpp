@@ -1,7 +1,5 @@
-#include "pico/util/datetime.h"
 #include "pico/cyw43_arch.h"
 #include "pico/multicore.h"
-#include "hardware/rtc.h"
 #include "pico/stdlib.h"
 #include "lwip/pbuf.h"
 #include "lwip/tcp.h"
@@ -16,6 +14,7 @@
 #include <time.h>
 #include <memory>
 #include <ctime>
+#include <string_view>
 #include <string>
 
 #include "./config.h"
@@ -23,194 +22,273 @@
 #ifndef __SERVER_UTILS_CPP__
 #define __SERVER_UTILS_CPP__
 
-#include "Crypto/BlockCipher.cpp"
-#include "Crypto/AESCommon.cpp"
-#include "Crypto/Crypto.cpp"
-#include "Crypto/AES256.cpp"
-#include "Crypto/Cipher.cpp"
-#include "Crypto/CTR.cpp"
+#include "./aes-ctr.cpp"
+#include "./buffer-pool.cpp"
+#include "./clock.cpp"
+#include "./event-bus.cpp"
+#include "./frame.cpp"
 
+#if TCP_SERVER_MAX_CLIENTS > 255
+#error "TCP_SERVER_MAX_CLIENTS can't be larger than 255"
+#endif
+
+#if TCP_SERVER_MAX_CLIENTS > MEMP_NUM_TCP_PCB
+#error "MEMP_NUM_TCP_PCB in lwipopts.h must be at least TCP_SERVER_MAX_CLIENTS"
+#endif
+
+#ifndef TCP_SERVER_SEND_QUEUE_SIZE
+#define TCP_SERVER_SEND_QUEUE_SIZE 8
+#endif
 
-#include "cpp-base64/base64.cpp"
+// Fits "255.255.255.255:65535"
+#define TCP_CLIENT_ID_SIZE 22
+
+struct TCP_SERVER_T_;
+
+enum class SEND_POLICY {
+  // Replies to requests, the receive backpressure keeps a queue entry free for them
+  NEVER_DROP,
+  // State broadcasts, when the queue is full the oldest one waiting is dropped
+  DROP_OLDEST
+};
+
+/**
+ * A frame waiting for room in the client's send buffer
+ */
+typedef struct TCP_SEND_ENTRY_T_ {
+  // Pool buffer, released once lwIP copied the frame
+  uint8_t *buffer = NULL;
+  // Used when no pool buffer was free or the frame is larger than one,
+  // shared like a pool buffer by the clients the frame is queued to
+  std::shared_ptr<std::string> data;
+  // The frame is `len` bytes from `offset` in the buffer
+  uint16_t offset = 0;
+  uint16_t len = 0;
+  bool droppable = false;
+} TCP_SEND_ENTRY_T;
 
 typedef struct TCP_CLIENT_T_ {
-  uint8_t buffer_sent[TCP_SERVER_BUF_SIZE];
-  uint8_t buffer_recv[TCP_SERVER_BUF_SIZE];
+  // Attached from the buffer pool only while a frame is partially received
+  uint8_t *buffer_recv = NULL;
+  // Monotonic times from clock_ms
   u_int64_t last_packet_tt = 0;
   u_int64_t last_ping = 0;
+  struct TCP_SERVER_T_ *server;
   struct tcp_pcb *client_pcb;
-  int packet_len = -1;
-  int data_len = 0;
-  int recv_len;
+  FRAME_DECODER_T decoder;
+  // Received data that wasn't handled yet, its bytes are acknowledged with tcp_recved once consumed
+  struct pbuf *rx_pending = NULL;
+  // Frames written once the send buffer has room, lwIP copies a frame
+  // (LWIP_NETIF_TX_SINGLE_PBUF) so it's released as soon as it's written
+  TCP_SEND_ENTRY_T send_queue[TCP_SERVER_SEND_QUEUE_SIZE];
+  uint8_t send_head = 0;
+  uint8_t send_count = 0;
+  uint8_t send_max_depth = 0;
+  uint32_t send_dropped = 0;
+  // Entries kept for the replies of the SET commands still waiting to be applied
+  uint8_t send_reserved = 0;
+  // Event bus topics the client is subscribed to and the ones with a value
+  // waiting for the rate limit, one bit per topic
+  uint32_t event_topics = 0;
+  uint32_t event_pending = 0;
+  uint16_t event_interval_ms = EVENT_BUS_INTERVAL_MS;
+  uint32_t event_next_ms[EVENT_BUS_MAX_TOPICS] = {};
+  // Topics where the client gets DELTA packets with only the subscribed fields
+  uint32_t event_delta_topics = 0;
+  FIELD_SUBSCRIPTION_T field_subscriptions[EVENT_BUS_MAX_FIELD_SUBSCRIPTIONS];
+  uint8_t field_subscriptions_count = 0;
+  // The pcb's tcp_arg points to the slot itself
+  uint8_t slot;
+  // Incremented every time the slot is reused, so handles to an old connection are rejected
+  uint16_t generation = 0;
+  bool in_use = false;
+  // The "ip:port" id is only built when it's needed for logs or packets
+  char id[TCP_CLIENT_ID_SIZE] = "";
 } TCP_CLIENT_T;
 
+/**
+ * The clients are a fixed slab of slots, accepting and closing
+ * a connection never allocates.
+ */
 typedef struct TCP_SERVER_T_ {
-  std::pair<std::string, std::shared_ptr<TCP_CLIENT_T>> clients[TCP_SERVER_MAX_CLIENTS];
+  TCP_CLIENT_T clients[TCP_SERVER_MAX_CLIENTS];
   struct tcp_pcb *server_pcb;
   bool opened;
 } TCP_SERVER_T;
 
-static std::string get_tcp_client_id(struct tcp_pcb *client) {
-  return std::string(ip4addr_ntoa(&client->remote_ip)) + ":" + std::to_string(client->remote_port);
-}
-
-static int index_of_tcp_client(TCP_SERVER_T *state, const std::string &id) {
-  for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
-    if (state->clients[i].first == id) {
-      return i;
-    }
-  }
+/**
+ * A handle identifies a connection (slot and generation), unlike a pointer
+ * to the slot it becomes invalid once the connection is closed.
+ */
+typedef uint32_t TCP_CLIENT_HANDLE;
 
-  return -1;
+static TCP_CLIENT_HANDLE tcp_client_handle(const TCP_CLIENT_T *client) {
+  return ((TCP_CLIENT_HANDLE)client->generation << 8) | client->slot;
 }
 
-static err_t tcp_close_client(struct tcp_pcb *tpcb) {
-  err_t err = ERR_OK;
-
-  if (tpcb == NULL) {
-    return err;
+static TCP_CLIENT_T* tcp_client_from_handle(TCP_SERVER_T *state, const TCP_CLIENT_HANDLE &handle) {
+  const uint8_t slot = handle & 0xFF;
+  if (slot >= TCP_SERVER_MAX_CLIENTS) {
+    return NULL;
   }
 
-  printf("[Server] Closing connection for %s\n", get_tcp_client_id(tpcb).c_str());
+  TCP_CLIENT_T *client = &state->clients[slot];
+  if (!client->in_use || tcp_client_handle(client) != handle) {
+    return NULL;
+  }
 
-  tcp_arg(tpcb, NULL);
-  tcp_poll(tpcb, NULL, 0);
-  tcp_sent(tpcb, NULL);
-  tcp_recv(tpcb, NULL);
-  tcp_err(tpcb, NULL);
-  err = tcp_close(tpcb);
+  return client;
+}
 
-  if (err != ERR_OK) {
-    printf("[Server] Close failed %d, calling abort\n", err);
-    tcp_abort(tpcb);
-    err = ERR_ABRT;
-  }
+/* #region Send queue */
 
-  return err;
+static TCP_SEND_ENTRY_T* tcp_client_send_entry(TCP_CLIENT_T *client, const uint8_t &index) {
+  return &client->send_queue[(client->send_head + index) % TCP_SERVER_SEND_QUEUE_SIZE];
 }
 
-u_int64_t get_datetime_ms() {
-  std::tm epoch_start;
-  epoch_start.tm_sec = 0;
-  epoch_start.tm_min = 0;
-  epoch_start.tm_hour = 0;
-  epoch_start.tm_mday = 1;
-  epoch_start.tm_mon = 0;
-  epoch_start.tm_year = 1970 - 1900;
-
-  std::time_t basetime = std::mktime(&epoch_start);
-
-  datetime_t dt;
-  rtc_get_datetime(&dt);
-
-  std::tm now = {};
-  now.tm_year = dt.year - 1900;
-  now.tm_mon = dt.month - 1;
-  now.tm_mday = dt.day;
-  now.tm_hour = dt.hour;
-  now.tm_min = dt.min;
-  now.tm_sec = dt.sec;
-
-  const u_int64_t ms = std::difftime(std::mktime(&now), basetime);
-  return ms * 1000;
+/**
+ * The first byte of the frame, in the pool buffer or in the frame's own data
+ */
+static const uint8_t* tcp_send_entry_frame(const TCP_SEND_ENTRY_T *entry) {
+  return (entry->buffer != NULL ? entry->buffer : (const uint8_t*)entry->data->data()) + entry->offset;
 }
 
-/* #region Encryption */
+static void tcp_client_send_entry_release(TCP_SEND_ENTRY_T *entry) {
+  buffer_pool_release(entry->buffer);
+  entry->buffer = NULL;
+  entry->data.reset();
+  entry->offset = 0;
+  entry->len = 0;
+}
 
-std::unique_ptr<u_int8_t[]> randomBytes(u_int8_t size) {
-  try {
-    static std::default_random_engine randomEngine(get_datetime_ms());
-    static std::uniform_int_distribution<u_int8_t> uniformDist(CHAR_MIN, CHAR_MAX);
+static void tcp_client_send_queue_pop(TCP_CLIENT_T *client) {
+  tcp_client_send_entry_release(tcp_client_send_entry(client, 0));
+  client->send_head = (client->send_head + 1) % TCP_SERVER_SEND_QUEUE_SIZE;
+  client->send_count--;
+}
 
-    std::vector<u_int8_t> data(size);
-    std::generate(data.begin(), data.end(), [] () {
-      return uniformDist(randomEngine);
-    });
+/**
+ * Drops the oldest droppable frame
+ */
+static bool tcp_client_send_queue_drop_oldest(TCP_CLIENT_T *client) {
+  for (uint8_t i = 0; i < client->send_count; i++) {
+    if (!tcp_client_send_entry(client, i)->droppable) {
+      continue;
+    }
 
-    std::unique_ptr<u_int8_t[]> buffer = std::make_unique<u_int8_t[]>(size);
+    tcp_client_send_entry_release(tcp_client_send_entry(client, i));
 
-    for (u_int8_t i = 0; i < size; i++) {
-      buffer[i] = u_int8_t(data[i]);
+    for (uint8_t j = i; j + 1 < client->send_count; j++) {
+      std::swap(*tcp_client_send_entry(client, j), *tcp_client_send_entry(client, j + 1));
     }
 
-    return buffer;
-  } catch (...) {
-    return nullptr;
+    client->send_count--;
+    client->send_dropped++;
+    return true;
   }
+
+  return false;
 }
 
-#ifdef AES_ENCRYPTION_KEY
+/**
+ * True when a frame with the NEVER_DROP policy can be queued without
+ * taking an entry kept for a deferred reply
+ */
+static bool tcp_client_send_queue_has_room(TCP_CLIENT_T *client) {
+  uint8_t kept = client->send_reserved;
+  for (uint8_t i = 0; i < client->send_count; i++) {
+    if (!tcp_client_send_entry(client, i)->droppable) {
+      kept++;
+    }
+  }
 
-std::string encrypt_256_aes_ctr(const std::string& value) {
-  try {
-    u_int8_t plaintext[value.length() + 1];
+  return kept < TCP_SERVER_SEND_QUEUE_SIZE;
+}
 
-    memcpy(plaintext, value.c_str(), value.length());
-    plaintext[value.length()] = '\0';
+/**
+ * Returns the entry for a new frame behind the ones waiting, or NULL if the frame
+ * has to be dropped. The frame is queued by `tcp_client_send_queue_commit`.
+ */
+static TCP_SEND_ENTRY_T* tcp_client_send_queue_reserve(TCP_CLIENT_T *client, const SEND_POLICY &policy) {
+  if (client->send_count >= TCP_SERVER_SEND_QUEUE_SIZE && !tcp_client_send_queue_drop_oldest(client)) {
+    client->send_dropped++;
+    return NULL;
+  }
 
-    u_int8_t key[32];
-    memcpy(key, base64_decode(std::string(AES_ENCRYPTION_KEY)).c_str(), 32);
+  TCP_SEND_ENTRY_T *entry = tcp_client_send_entry(client, client->send_count);
+  entry->droppable = policy == SEND_POLICY::DROP_OLDEST;
 
-    const u_int8_t* iv = randomBytes(16).release();
-    if (iv == nullptr) {
-      return "";
-    }
+  return entry;
+}
 
-    CTR<AES256> ctr;
-    ctr.clear();
-    ctr.setKey(key, 32);
-    ctr.setIV(iv, 16);
-    ctr.setCounterSize(4);
+static void tcp_client_send_queue_commit(TCP_CLIENT_T *client) {
+  client->send_count++;
+  if (client->send_count > client->send_max_depth) {
+    client->send_max_depth = client->send_count;
+  }
+}
 
-    u_int8_t output[value.length() + 1];
-    ctr.encrypt(output, plaintext, value.length());
-    output[value.length()] = '\0';
+static void tcp_client_send_queue_clear(TCP_CLIENT_T *client) {
+  while (client->send_count > 0) {
+    tcp_client_send_queue_pop(client);
+  }
+
+  client->send_head = 0;
+  client->send_max_depth = 0;
+  client->send_dropped = 0;
+  client->send_reserved = 0;
+}
 
-    const std::string encrypted = base64_encode(std::string(iv, iv + 16) + std::string(output, output + value.length()));
-    delete [] iv;
-    iv = nullptr;
+/* #endregion */
 
-    return encrypted;
-  } catch (...) {
-    return "";
+static uint8_t tcp_server_clients_count(const TCP_SERVER_T *state) {
+  uint8_t count = 0;
+  for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+    if (state->clients[i].in_use) {
+      count++;
+    }
   }
+
+  return count;
 }
 
-std::string decrypt_256_aes_ctr(const std::string& value) {
-  try {
-    const std::string decoded_value = base64_decode(value);
+static void format_tcp_client_id(struct tcp_pcb *client, char *buffer) {
+  snprintf(buffer, TCP_CLIENT_ID_SIZE, "%s:%u", ip4addr_ntoa(&client->remote_ip), client->remote_port);
+}
 
-    const std::string s_iv = decoded_value.substr(0, 16);
-    const std::string raw = decoded_value.substr(16, decoded_value.length());
+static const char* tcp_client_id(TCP_CLIENT_T *client) {
+  if (client->id[0] == '\0' && client->client_pcb != NULL) {
+    format_tcp_client_id(client->client_pcb, client->id);
+  }
 
-    u_int8_t chifertext[raw.length() + 1];
+  return client->id;
+}
 
-    memcpy(chifertext, raw.c_str(), raw.length());
-    chifertext[raw.length()] = '\0';
+static err_t tcp_close_client(struct tcp_pcb *tpcb) {
+  err_t err = ERR_OK;
 
-    u_int8_t iv[16];
-    memcpy(iv, s_iv.c_str(), 16);
+  if (tpcb == NULL) {
+    return err;
+  }
 
-    u_int8_t key[32];
-    memcpy(key, base64_decode(std::string(AES_ENCRYPTION_KEY)).c_str(), 32);
+  char client_id[TCP_CLIENT_ID_SIZE];
+  format_tcp_client_id(tpcb, client_id);
+  printf("[Server] Closing connection for %s\n", client_id);
 
-    CTR<AES256> ctr;
-    ctr.clear();
-    ctr.setKey(key, 32);
-    ctr.setIV(iv, 16);
-    ctr.setCounterSize(4);
-    
-    u_int8_t output[raw.length() + 1];
-    ctr.encrypt(output, chifertext, raw.length());
-    output[raw.length()] = '\0';
+  tcp_arg(tpcb, NULL);
+  tcp_poll(tpcb, NULL, 0);
+  tcp_sent(tpcb, NULL);
+  tcp_recv(tpcb, NULL);
+  tcp_err(tpcb, NULL);
+  err = tcp_close(tpcb);
 
-    return std::string(output, output + raw.length());
-  } catch (...) {
-    return "";
+  if (err != ERR_OK) {
+    printf("[Server] Close failed %d, calling abort\n", err);
+    tcp_abort(tpcb);
+    err = ERR_ABRT;
   }
-}
 
-#endif
-/* #endregion */
+  return err;
+}
 
 #endif
\ No newline at end of file
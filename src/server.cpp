@@ -17,7 +17,7 @@
 #include "lwip/tcp.h"
 #include <stdlib.h>
 #include <stdio.h>
-#include <sstream>
+#include <string_view>
 #include <memory>
 #include <string>
 
@@ -25,43 +25,91 @@
 
 #include "./server-utils.cpp"
 #include "./handler.cpp"
+#include "./stream.cpp"
+#include "./udp-server.cpp"
 
 #ifndef __SERVER_CPP__
 #define __SERVER_CPP__
 
+// A partial frame is dropped when the rest of it doesn't arrive within this time
+#define TCP_SERVER_REASSEMBLY_TIMEOUT_MS 1500
+
+static TCP_SERVER_T tcp_server_state_storage;
+
 static TCP_SERVER_T* tcp_server_init(void) {
-  TCP_SERVER_T *state = static_cast<TCP_SERVER_T*>(calloc(1, sizeof(TCP_SERVER_T)));
+  TCP_SERVER_T *state = &tcp_server_state_storage;
 
-  if (!state) {
-    printf("[Server] Failed to allocate state\n");
-    return NULL;
+  for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+    state->clients[i].server = state;
+    state->clients[i].slot = i;
+    state->clients[i].in_use = false;
   }
 
+  state->server_pcb = NULL;
+  state->opened = false;
+
   return state;
 }
 
-static int first_empty_client_slot(TCP_SERVER_T *state) {
+static TCP_CLIENT_T* first_empty_client_slot(TCP_SERVER_T *state) {
   for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
-    if (state->clients[i].first == "") {
-      return i;
+    if (!state->clients[i].in_use) {
+      return &state->clients[i];
     }
   }
 
-  return -1;
+  return NULL;
+}
+
+static bool tcp_server_attach_buffer(TCP_CLIENT_T *client) {
+  if (client->buffer_recv == NULL) {
+    client->buffer_recv = buffer_pool_acquire();
+  }
+
+  return client->buffer_recv != NULL;
 }
 
-static err_t tcp_close_client_by_index(TCP_SERVER_T *state, const int &index) {
-  const err_t err = tcp_close_client(state->clients[index].second->client_pcb);
-  state->clients[index].second.reset();
-  state->clients[index].first = "";
+static void tcp_server_detach_buffer(TCP_CLIENT_T *client) {
+  buffer_pool_release(client->buffer_recv);
+  client->buffer_recv = NULL;
+}
+
+static void tcp_server_release_rx(TCP_CLIENT_T *client) {
+  frame_decoder_reset(&client->decoder);
+  tcp_server_detach_buffer(client);
+
+  if (client->rx_pending != NULL) {
+    pbuf_free(client->rx_pending);
+    client->rx_pending = NULL;
+  }
+}
+
+static void tcp_server_free_client(TCP_CLIENT_T *client) {
+  tcp_server_release_rx(client);
+  tcp_client_send_queue_clear(client);
+  client->client_pcb = NULL;
+  client->in_use = false;
+}
+
+/**
+ * The queued frames that fit in the send buffer are written before the
+ * connection is closed, lwIP keeps sending its copy after tcp_close.
+ */
+static err_t tcp_server_close_client(TCP_CLIENT_T *client) {
+  if (client->client_pcb != NULL) {
+    tcp_server_flush_send_queue(client);
+  }
+
+  const err_t err = tcp_close_client(client->client_pcb);
+  tcp_server_free_client(client);
 
   return err;
 }
 
 static void close_all_tcp_clients(TCP_SERVER_T *state) {
   for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
-    if (state->clients[i].first != "") {
-      tcp_close_client_by_index(state, i);
+    if (state->clients[i].in_use) {
+      tcp_server_close_client(&state->clients[i]);
     }
   }
 }
@@ -82,120 +130,188 @@ static err_t tcp_server_close(void *arg) {
   return ERR_OK;
 }
 
-static err_t tcp_server_sent(void *arg, struct tcp_pcb *tpcb, u16_t len) {
-  TCP_SERVER_T *state = static_cast<TCP_SERVER_T*>(arg);
-  printf("[Server] %u bytes sent to client %s\n", len, get_tcp_client_id(tpcb).c_str());
-  return ERR_OK;
+/**
+ * A frame is only handled while at least half of the send buffer is free,
+ * otherwise the data stays in `rx_pending` and the TCP window isn't reopened.
+ */
+static bool tcp_server_can_reply(TCP_CLIENT_T *client) {
+  return tcp_sndbuf(client->client_pcb) >= TCP_SND_BUF / 2 && tcp_sndqueuelen(client->client_pcb) < TCP_SND_QUEUELEN / 2 && tcp_client_send_queue_has_room(client);
 }
 
-err_t tcp_server_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
-  try {
-    TCP_SERVER_T *state = static_cast<TCP_SERVER_T*>(arg);
-    const std::string client_id = get_tcp_client_id(tpcb);
+static void tcp_server_dispatch_frame(TCP_CLIENT_T *client) {
+  const PEER_T peer = peer_from_tcp_client(client);
 
-    if (err != 0) {
-      printf("[Server] Receiver error %d (%s)\n", err, client_id.c_str());
+  if (client->decoder.stream != nullptr) {
+    if (!packet_stream.end()) {
+      printf("[Server] Invalid streamed packet from %s\n", peer.id);
+      tcp_server_send_data(client, create_error_packet(peer.id, "Failed to parse data"));
+      return;
     }
 
-    const int client_index = index_of_tcp_client(state, client_id);
+    PacketSax &packet = packet_stream.packet();
+    handle_client_packet(&peer, packet.type, packet.id, packet.body);
+    return;
+  }
 
-    if (client_index == -1) {
-      printf("[Server] Client %s not found\n", client_id.c_str());
-      tcp_close_client(tpcb);
-      pbuf_free(p);
-      return ERR_VAL;
+  handle_client_frame(&peer, std::string_view((char*)client->buffer_recv, client->decoder.packet_len));
+}
+
+/**
+ * Decodes the pending data of a client, every complete frame is dispatched
+ * and only the consumed bytes are acknowledged to lwIP.
+ */
+static err_t tcp_server_process_pending(TCP_CLIENT_T *client) {
+  uint16_t consumed = 0;
+
+  // A segment can hold the end of a frame and any number of pipelined frames,
+  // every complete frame is dispatched and the decoder keeps the partial one.
+  while (client->rx_pending != NULL) {
+    if (!tcp_server_can_reply(client)) {
+      printf("[Server] Send buffer full for %s, holding %d bytes\n", tcp_client_id(client), client->rx_pending->tot_len);
+      break;
     }
 
-    if (!p) {
-      tcp_close_client_by_index(state, client_index);
-      pbuf_free(p);
-      return ERR_VAL;
+    if (!tcp_server_attach_buffer(client)) {
+      printf("[Server] No free buffer for %s, holding %d bytes\n", tcp_client_id(client), client->rx_pending->tot_len);
+      break;
     }
 
-    std::shared_ptr<TCP_CLIENT_T> client = (state->clients[client_index]).second;
+    const uint16_t used = frame_decoder_feed_pbuf(&client->decoder, client->buffer_recv, TCP_SERVER_BUF_SIZE, &packet_stream, client->rx_pending, 0);
+    client->rx_pending = pbuf_free_header(client->rx_pending, used);
+    consumed += used;
 
-    cyw43_arch_lwip_check();
-    if (p->tot_len > 0) {
-      const u_int64_t now = get_datetime_ms();
-      if (now - client->last_packet_tt > 1500) {
-        client->packet_len = -1;
-      }
+    if (client->decoder.state == FRAME_STATE::MALFORMED) {
+      printf("[Server] Malformed packet from %s\n", tcp_client_id(client));
+      return tcp_server_close_client(client);
+    }
 
-      client->last_packet_tt = now;
+    if (client->decoder.state == FRAME_STATE::COMPLETE) {
+      tcp_server_dispatch_frame(client);
+      frame_decoder_reset(&client->decoder);
+    }
+  }
 
-      if (client->packet_len == -1) {
-        client->recv_len = 0;
-      }
+  if (consumed > 0) {
+    tcp_recved(client->client_pcb, consumed);
+  }
 
-      printf("[Server] Received %d bytes (%d are from previous packets) from (%s)\n", p->tot_len, client->recv_len, client_id.c_str());
+  // Idle clients and streamed frames don't need the buffer
+  if (frame_decoder_idle(&client->decoder) || client->decoder.stream != nullptr) {
+    tcp_server_detach_buffer(client);
+  }
 
-      const uint16_t buffer_left = TCP_SERVER_BUF_SIZE - client->recv_len;
-      client->recv_len += pbuf_copy_partial(
-        p, client->buffer_recv + client->recv_len,
-        p->tot_len > buffer_left ? buffer_left : p->tot_len, 0\
-      );
+  return ERR_OK;
+}
 
-      tcp_recved(tpcb, p->tot_len);
+/**
+ * Continues the clients that were waiting for a free buffer
+ */
+static void tcp_server_resume_clients(TCP_SERVER_T *state) {
+  for (int i = 0; i < TCP_SERVER_MAX_CLIENTS && buffer_pool_free() > 0; i++) {
+    TCP_CLIENT_T *client = &state->clients[i];
+
+    if (client->in_use && client->rx_pending != NULL && client->buffer_recv == NULL) {
+      tcp_server_process_pending(client);
     }
+  }
+}
 
-    if (client->packet_len == -1) {
-      std::string partial_packet((char*)client->buffer_recv, client->recv_len);
-      std::string packet_length_s;
+static err_t tcp_server_sent(void *arg, struct tcp_pcb *tpcb, u16_t len) {
+  TCP_CLIENT_T *client = static_cast<TCP_CLIENT_T*>(arg);
+  if (client == NULL || !client->in_use || client->client_pcb != tpcb) {
+    return ERR_OK;
+  }
 
-      std::istringstream iss_input(partial_packet);
-      std::getline(iss_input, packet_length_s, ';');
+  printf("[Server] %u bytes sent to client %s\n", len, tcp_client_id(client));
 
-      if (packet_length_s != partial_packet) {
-        int packet_length = std::stoi(packet_length_s);
-        if (packet_length > 0) {
-          client->packet_len = packet_length + packet_length_s.size() + 1;
-          client->data_len = packet_length_s.size() + 1;
-        }
-      }
+  tcp_server_flush_send_queue(client);
+
+  if (client->rx_pending != NULL) {
+    return tcp_server_process_pending(client);
+  }
+
+  return ERR_OK;
+}
+
+err_t tcp_server_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
+  TCP_CLIENT_T *client = static_cast<TCP_CLIENT_T*>(arg);
+
+  if (client == NULL || !client->in_use || client->client_pcb != tpcb) {
+    printf("[Server] Client not found\n");
+    pbuf_free(p);
+    return tcp_close_client(tpcb);
+  }
+
+  try {
+    if (err != 0) {
+      printf("[Server] Receiver error %d (%s)\n", err, tcp_client_id(client));
     }
-    
-    if (client->recv_len >= client->packet_len) {
-      std::string packet((char*)client->buffer_recv, client->data_len, client->packet_len - client->data_len);
-
-#ifdef AES_ENCRYPTION_KEY
-      printf("[Server] Decrypting packet from %s\n", client_id.c_str());
-      packet = decrypt_256_aes_ctr(packet);
-      printf("[Server] Packet decrypted from %s (%s)\n", client_id.c_str(), packet.c_str());
-#endif
 
-      if (packet != "") {
-        handle_client_response(arg, tpcb, packet);
+    if (!p) {
+      return tcp_server_close_client(client);
+    }
+
+    cyw43_arch_lwip_check();
+
+    const u_int64_t now = clock_ms();
+    if (client->rx_pending == NULL) {
+      if (now - client->last_packet_tt > TCP_SERVER_REASSEMBLY_TIMEOUT_MS) {
+        frame_decoder_reset(&client->decoder);
       }
 
-      client->packet_len = -1;
-      client->recv_len = 0;
+      client->rx_pending = p;
+    } else {
+      pbuf_cat(client->rx_pending, p);
     }
 
-    pbuf_free(p);
-    return ERR_OK;
+    client->last_packet_tt = now;
+
+    printf("[Server] Received %d bytes (%d are from previous packets) from (%s)\n", p->tot_len, client->decoder.recv_len, tcp_client_id(client));
+
+    return tcp_server_process_pending(client);
   } catch (const std::exception &e) {
     printf("[Server] Exception: %s\n", e.what());
-    pbuf_free(p);
-    return ERR_VAL;
+    return tcp_server_close_client(client);
   }
 }
 
 static err_t tcp_server_poll(void *arg, struct tcp_pcb *tpcb) {
-  TCP_SERVER_T *state = static_cast<TCP_SERVER_T*>(arg);
-  const std::string client_id = get_tcp_client_id(tpcb);
-  const int client_index = index_of_tcp_client(state, client_id);
+  TCP_CLIENT_T *client = static_cast<TCP_CLIENT_T*>(arg);
+
+  if (client == NULL || !client->in_use || client->client_pcb != tpcb) {
+    return ERR_OK;
+  }
 
   try {
-    std::shared_ptr<TCP_CLIENT_T> client = (state->clients[client_index]).second;
-    const u_int64_t now = get_datetime_ms();
+    const u_int64_t now = clock_ms();
     const u_int64_t diff = (now - client->last_ping) / 1000;
     if (diff > TCP_SERVER_INACTIVE_TIME_S) {
-      printf("[Server] Client %s is inactive for %s seconds\n", client_id.c_str(), std::to_string(diff).c_str());
-      tcp_close_client_by_index(state, client_index);
+      printf("[Server] Client %s is inactive for %llu seconds\n", tcp_client_id(client), diff);
+      return tcp_server_close_client(client);
+    }
+
+    // A client that stopped in the middle of a frame gives its pool buffer
+    // back, otherwise a few stalled clients hold all the buffers until they
+    // are closed as inactive. The held data of a throttled client isn't stale.
+    if (!frame_decoder_idle(&client->decoder) && client->rx_pending == NULL && now - client->last_packet_tt > TCP_SERVER_REASSEMBLY_TIMEOUT_MS) {
+      printf("[Server] Dropping the partial packet of %s\n", tcp_client_id(client));
+      frame_decoder_reset(&client->decoder);
+      tcp_server_detach_buffer(client);
+    }
+
+    // tcp_write fails with ERR_MEM when lwIP is out of segments, if nothing
+    // was in flight for the client no `sent` callback writes the queue
+    if (client->send_count > 0) {
+      tcp_server_flush_send_queue(client);
+    }
+
+    // Fallback for the held data when no other client released a buffer
+    if (client->rx_pending != NULL) {
+      return tcp_server_process_pending(client);
     }
   } catch (...) {
-    printf("[Server] Poll error for %s\n", client_id.c_str());
-    tcp_close_client_by_index(state, client_index);
+    printf("[Server] Poll error for %s\n", tcp_client_id(client));
+    return tcp_server_close_client(client);
   }
 
   return ERR_OK;
@@ -207,6 +323,12 @@ static void tcp_server_err(void *arg, err_t err) {
   } else {
     printf("[Server] Client aborted error\n");
   }
+
+  // The pcb is already freed by lwIP, only the slot has to be released
+  TCP_CLIENT_T *client = static_cast<TCP_CLIENT_T*>(arg);
+  if (client != NULL && client->in_use) {
+    tcp_server_free_client(client);
+  }
 }
 
 static err_t tcp_server_accept(void *arg, struct tcp_pcb *client_pcb, err_t err) {
@@ -218,30 +340,32 @@ static err_t tcp_server_accept(void *arg, struct tcp_pcb *client_pcb, err_t err)
       return ERR_VAL;
     }
 
-    const std::string client_id = get_tcp_client_id(client_pcb);
-
-    if (index_of_tcp_client(state, client_id) >= 0) {
-      printf("[Server] Client already connected (%s)\n", client_id.c_str());
-      return ERR_OK;
-    }
-
-    const int empty_index = first_empty_client_slot(state);
-    if (empty_index < 0) {
+    TCP_CLIENT_T *client = first_empty_client_slot(state);
+    if (client == NULL) {
       printf("[Server] No empty client slot\n");
       tcp_close_client(client_pcb);
       return ERR_ABRT;
     }
 
-    printf("[Server] Client connected (%s) on (%d)\n", client_id.c_str(), empty_index);
-
-    std::shared_ptr<TCP_CLIENT_T> client = std::make_shared<TCP_CLIENT_T>();
-    state->clients[empty_index] = std::make_pair(client_id, client);
-
-    const u_int64_t now = get_datetime_ms();
+    const u_int64_t now = clock_ms();
 
+    frame_decoder_reset(&client->decoder);
+    client->generation++;
+    client->in_use = true;
     client->client_pcb = client_pcb;
+    client->last_packet_tt = 0;
     client->last_ping = now;
-    tcp_arg(client_pcb, state);
+    client->id[0] = '\0';
+    client->event_topics = UINT32_MAX;
+    client->event_pending = 0;
+    client->event_interval_ms = EVENT_BUS_INTERVAL_MS;
+    std::fill_n(client->event_next_ms, EVENT_BUS_MAX_TOPICS, 0);
+    client->event_delta_topics = 0;
+    client->field_subscriptions_count = 0;
+
+    printf("[Server] Client connected (%s) on (%d)\n", tcp_client_id(client), client->slot);
+
+    tcp_arg(client_pcb, client);
     tcp_sent(client_pcb, tcp_server_sent);
     tcp_recv(client_pcb, tcp_server_recv);
     tcp_poll(client_pcb, tcp_server_poll, TCP_SERVER_POLL_TIME_S * 2);
@@ -249,10 +373,15 @@ static err_t tcp_server_accept(void *arg, struct tcp_pcb *client_pcb, err_t err)
 
     return ERR_OK;
   } catch (...) {
-    const std::string client_id = get_tcp_client_id(client_pcb);
-    printf("[Server] Exception in accept (%s)\n", client_id.c_str());
+    printf("[Server] Exception in accept\n");
+
+    for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+      if (state->clients[i].in_use && state->clients[i].client_pcb == client_pcb) {
+        tcp_server_free_client(&state->clients[i]);
+      }
+    }
 
-    tcp_close_client_by_index(state, index_of_tcp_client(state, client_id));
+    tcp_close_client(client_pcb);
     return ERR_ABRT;
   }
 }
@@ -292,56 +421,141 @@ static bool tcp_server_open(void *arg) {
   return true;
 }
 
-uint32_t last_wifi_check = 0;
+/* #region Workers */
+
+#define WIFI_CHECK_INTERVAL_MS 10000
+
+static async_when_pending_worker_t event_bus_worker = {};
+// Wakes up the event bus worker when a client is waiting for its interval
+static async_at_time_worker_t event_bus_timer = {};
+static async_at_time_worker_t wifi_check_worker = {};
+static async_when_pending_worker_t service_commands_worker = {};
+// Continues the clients waiting for a buffer once one is released
+static async_when_pending_worker_t resume_clients_worker = {};
+
+// Times the main loop was woken up, the idle core should be woken up only by events
+static volatile uint32_t idle_loop_iterations = 0;
+
+static void event_bus_worker_notify() {
+  async_context_set_work_pending(cyw43_arch_async_context(), &event_bus_worker);
+}
+
+static void service_commands_worker_notify() {
+  async_context_set_work_pending(cyw43_arch_async_context(), &service_commands_worker);
+}
+
+static void resume_clients_worker_notify() {
+  async_context_set_work_pending(cyw43_arch_async_context(), &resume_clients_worker);
+}
+
+static void resume_clients_do_work(async_context_t *context, async_when_pending_worker_t *worker) {
+  tcp_server_resume_clients(static_cast<TCP_SERVER_T*>(worker->user_data));
+}
+
+static void service_commands_do_work(async_context_t *context, async_when_pending_worker_t *worker) {
+  handle_service_completions();
+}
+
+static void event_bus_do_work(async_context_t *context, async_when_pending_worker_t *worker) {
+  const int32_t next = event_bus_dispatch(static_cast<TCP_SERVER_T*>(worker->user_data));
+
+  async_context_remove_at_time_worker(context, &event_bus_timer);
+  if (next >= 0) {
+    async_context_add_at_time_worker_in_ms(context, &event_bus_timer, next);
+  }
+}
+
+static void event_bus_timer_do_work(async_context_t *context, async_at_time_worker_t *worker) {
+  async_context_set_work_pending(context, &event_bus_worker);
+}
+
+static void wifi_check_do_work(async_context_t *context, async_at_time_worker_t *worker) {
+  const int status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+  switch(status) {
+    case CYW43_LINK_DOWN:
+    case CYW43_LINK_FAIL:
+    case CYW43_LINK_NONET:
+      printf("[Wifi-Check] WiFi down\n");
+      cyw43_arch_wifi_connect_async(WIFI_SSID, WIFI_PASSWORD, WIFI_AUTH);
+      break;
+    case CYW43_LINK_BADAUTH:
+      printf("[Wifi-Check] WiFi bad auth\n");
+      break;
+    case CYW43_LINK_JOIN:
+      printf("[Wifi-Check] WiFi join\n");
+      break;
+    case CYW43_LINK_NOIP:
+      printf("[Wifi-Check] WiFi no IP\n");
+      break;
+  }
+
+#ifdef IS_DEBUG_MODE
+  const uint32_t iterations = idle_loop_iterations;
+  idle_loop_iterations = 0;
+  printf("[Server] Main loop woke up %u times/s\n", iterations * 1000 / WIFI_CHECK_INTERVAL_MS);
+#endif
+
+  async_context_add_at_time_worker_in_ms(context, worker, WIFI_CHECK_INTERVAL_MS);
+}
+
+static void tcp_server_add_workers(TCP_SERVER_T *state) {
+  async_context_t *context = cyw43_arch_async_context();
 
+  event_bus_worker.do_work = event_bus_do_work;
+  event_bus_worker.user_data = state;
+  event_bus_timer.do_work = event_bus_timer_do_work;
+  wifi_check_worker.do_work = wifi_check_do_work;
+  service_commands_worker.do_work = service_commands_do_work;
+  resume_clients_worker.do_work = resume_clients_do_work;
+  resume_clients_worker.user_data = state;
+
+  async_context_add_when_pending_worker(context, &event_bus_worker);
+  async_context_add_when_pending_worker(context, &service_commands_worker);
+  async_context_add_when_pending_worker(context, &resume_clients_worker);
+  async_context_add_at_time_worker_in_ms(context, &wifi_check_worker, WIFI_CHECK_INTERVAL_MS);
+
+  // The values published before the server started are sent on the first run
+  event_bus.notify = event_bus_worker_notify;
+  async_context_set_work_pending(context, &event_bus_worker);
+
+  service_commands.notify = service_commands_worker_notify;
+  async_context_set_work_pending(context, &service_commands_worker);
+
+  // Every release of a pool buffer (a written frame, a closed client, a UDP datagram) wakes up the waiting clients
+  buffer_pool.notify = resume_clients_worker_notify;
+}
+
+/* #endregion */
+
+/**
+ * The network, the event bus, the service commands and the Wi-Fi check run as workers of the
+ * cyw43 async context, core 0 sleeps until an interrupt or a worker wakes it up.
+ */
 void start_tcp_server_module() {
   TCP_SERVER_T *tcp_server_state = tcp_server_init();
-  if (!tcp_server_state) {
-    return;
-  }
 
   if (!tcp_server_open(tcp_server_state)) {
     return;
   }
 
-  while(tcp_server_state->opened) {
-    sender_main_loop(tcp_server_state);
-
-    const uint32_t now = to_ms_since_boot(get_absolute_time());
-
-    if (now - last_wifi_check > 10000) {
-      last_wifi_check = now;
-
-      const int status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
-      switch(status) {
-        case CYW43_LINK_DOWN:
-        case CYW43_LINK_FAIL:
-        case CYW43_LINK_NONET:
-          printf("[Wifi-Check] WiFi down\n");
-          cyw43_arch_wifi_connect_async(WIFI_SSID, WIFI_PASSWORD, WIFI_AUTH);
-          break;
-        case CYW43_LINK_BADAUTH:
-          printf("[Wifi-Check] WiFi bad auth\n");
-          break;
-        case CYW43_LINK_JOIN:
-          printf("[Wifi-Check] WiFi join\n");
-          break;
-        case CYW43_LINK_NOIP:
-          printf("[Wifi-Check] WiFi no IP\n");
-          break;
-      }
-    }
+#ifdef UDP_SERVER_PORT
+  udp_server_open(tcp_server_state);
+#endif
+
+  tcp_server_add_workers(tcp_server_state);
 
+  while(tcp_server_state->opened) {
 #if PICO_CYW43_ARCH_POLL
     cyw43_arch_poll();
-    sleep_ms(1);
+    cyw43_arch_wait_for_work_until(make_timeout_time_ms(WIFI_CHECK_INTERVAL_MS));
 #else
-    tight_loop_contents();
+    __wfe();
 #endif
+
+    idle_loop_iterations = idle_loop_iterations + 1;
   }
 
   printf("[Server] Closed\n");
-  free(tcp_server_state);
 }
 
 #endif
\ No newline at end of file
@@ -9,6 +9,9 @@
 #include "types.cpp"
 #include "server-utils.cpp"
 #include "sender.cpp"
+#include "event-bus.cpp"
+#include "command-queue.cpp"
+#include "seqlock.cpp"
 
 #ifndef INCLUDE_NLOHMANN_JSON_HPP_
 #include "nlohmann/json.hpp"
@@ -30,6 +33,25 @@ using json = nlohmann::json;
 #define MS_TO_REACH_MAX_BOTTOM 10500.0
 #define MS_TO_REACH_MAX_TOP 15500.0
 
+typedef struct DESK_STATE_T_ {
+  uint8_t position_state;
+  double current_height;
+  double target_height;
+} DESK_STATE_T;
+
+void to_json(json &j, const DESK_STATE_T &state) {
+  j = {
+    {"position_state", state.position_state},
+    {"current_height", state.current_height},
+    {"target_height", state.target_height}
+  };
+}
+
+static const char *const DESK_STATE_FIELDS[] = {"position_state", "current_height", "target_height"};
+
+// Published from core 1 when the desk stops, sent as a GET packet to the clients
+LatestEventTopic<DESK_STATE_T> desk_state_topic("state", PACKET_TYPE::GET, DESK_STATE_FIELDS, 3);
+
 class Desk {
   private:
     alarm_id_t moving_check_alarm;
@@ -51,8 +73,19 @@ class Desk {
      */
     double current_height = 0;
 
+    // The state read by core 0, updated on core 1 after every change
+    Seqlock<DESK_STATE_T> snapshot;
+
+    void update_snapshot() {
+      // The alarm callback can't change the state between get_state and store
+      const uint32_t interrupts = save_and_disable_interrupts();
+      this->snapshot.store(this->get_state());
+      restore_interrupts(interrupts);
+    }
+
     void send_get_packet() {
-      send_get_packet_to_all(this->get_data());
+      this->update_snapshot();
+      desk_state_topic.publish(this->get_state());
     }
 
     void button_reset() {
@@ -84,6 +117,7 @@ class Desk {
       this->hold_at = 0;
       this->set_target_height(diff_percent);
       this->current_height = this->target_height;
+      this->update_snapshot();
     }
 
     double calculate_percent_diff(const uint16_t diff, const bool up) {
@@ -119,6 +153,7 @@ class Desk {
       double diff_percent = this->calculate_percent_diff(diff, this->stop_at_up);
 
       this->current_height = diff_percent;
+      this->update_snapshot();
     }
 
     static int64_t check_alarm_callback(alarm_id_t id, void *user_data) {
@@ -153,6 +188,7 @@ class Desk {
 
     void ready() {
       printf("[Desk] Service ready\n");
+      this->update_snapshot();
       this->_ready = true;
     }
 
@@ -230,6 +266,7 @@ class Desk {
           this->button_pressed(true, true);
         } else {
           this->button_reset();
+          this->update_snapshot();
           return;
         }
 
@@ -237,6 +274,8 @@ class Desk {
         this->moving_check_alarm = alarm_pool_add_alarm_in_ms(core_1_alarm_pool, diff, Desk::check_alarm_callback, this, true);
         this->stop_at_start = to_ms_since_boot(get_absolute_time());
       }
+
+      this->update_snapshot();
     }
 
     // Getters
@@ -270,43 +309,66 @@ class Desk {
       return 2;
     }
 
-    json get_data() {
+    DESK_STATE_T get_state() {
       return {
-        {"position_state", this->get_position_state()},
-        {"current_height", this->get_current_height()},
-        {"target_height", this->get_target_height()}
+        this->get_position_state(),
+        this->get_current_height(),
+        this->get_target_height()
       };
     }
+
+    /**
+     * Called on core 0, returns false before the service is ready
+     */
+    bool load_state(DESK_STATE_T &state) const {
+      return this->snapshot.load(state);
+    }
 };
 
 Desk service = Desk();
 
-json service_handle_packet(const json &body, const PACKET_TYPE &type) {
-  try {
-    if (!service.is_ready()) {
-      return {};
-    }
+typedef struct DESK_COMMAND_T_ {
+  bool has_target_height;
+  double target_height;
+} DESK_COMMAND_T;
 
-    switch (type) {
-      case PACKET_TYPE::GET:
-        break;
-      case PACKET_TYPE::SET: {
-        double target_height = body.value(
-          "target_height", 
-          service.get_target_height()
-        );
-
-        service.set_target_height(target_height, true);
-        break;
-      }
-      default:
-        return {};
-    }
+CommandQueue<DESK_COMMAND_T> service_commands;
 
-    return service.get_data();
-  } catch (...) {
+json service_get_data() {
+  DESK_STATE_T state;
+  if (!service.load_state(state)) {
     return {};
   }
+
+  return state;
+}
+
+/**
+ * Called on core 0 for a SET packet, returns the token of the command or 0 if the queue is full
+ */
+uint32_t service_submit_command(const json &body) {
+  DESK_COMMAND_T command = {};
+
+  if (body.contains("target_height")) {
+    command.has_target_height = true;
+    command.target_height = body["target_height"].get<double>();
+  }
+
+  return service_commands.submit(command);
+}
+
+/**
+ * Called from the loop on core 1
+ */
+void service_run_commands() {
+  service_commands.process([] (const DESK_COMMAND_T &command) {
+    try {
+      service.set_target_height(
+        command.has_target_height ? command.target_height : service.get_target_height(),
+        true
+      );
+    } catch (...) { }
+  });
 }
 
 #endif
\ No newline at end of file
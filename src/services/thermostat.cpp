@@ -5,6 +5,9 @@
 #include <string>
 
 #include "types.cpp"
+#include "event-bus.cpp"
+#include "command-queue.cpp"
+#include "seqlock.cpp"
 #include "extras/Display.cpp"
 
 #ifndef INCLUDE_NLOHMANN_JSON_HPP_
@@ -26,6 +29,31 @@ using json = nlohmann::json;
 #define MINUS_TEMP_GPIO_PIN     16
 #define RELAY_GPIO_PIN          15
 
+typedef struct THERMOSTAT_STATE_T_ {
+  double target_temperature;
+  double temperature;
+  bool celsius;
+  bool winter;
+  int humidity;
+  bool heating;
+} THERMOSTAT_STATE_T;
+
+void to_json(json &j, const THERMOSTAT_STATE_T &state) {
+  j = {
+    {"target_temperature", state.target_temperature},
+    {"temperature", state.temperature},
+    {"celsius", state.celsius},
+    {"winter", state.winter},
+    {"humidity", state.humidity},
+    {"heating", state.heating}
+  };
+}
+
+static const char *const THERMOSTAT_STATE_FIELDS[] = {"target_temperature", "temperature", "celsius", "winter", "humidity", "heating"};
+
+// Published from core 1 when the state changes, sent as a GET packet to the clients
+LatestEventTopic<THERMOSTAT_STATE_T> thermostat_state_topic("state", PACKET_TYPE::GET, THERMOSTAT_STATE_FIELDS, 6);
+
 class Thermostat {
   private:
     constexpr static uint8_t C_POS[2] = { 29, 8 };
@@ -34,16 +62,20 @@ class Thermostat {
 
     bool _ready = false;
     // Trigger the update a second time for better accuracy
-    bool alarm_triggered = true;
+    volatile bool alarm_triggered = true;
+    // Set every second by the timer, the check runs in the loop
+    volatile bool check_triggered = false;
     bool button_pressed = false;
 
     struct repeating_timer timer;
 
-    mutex_t m_read_temp;
-    mutex_t m_heating;
     mutex_t m_t_display;
 
-    bool prev_heating = false;
+    // Updated by the check every second
+    bool heating = false;
+    THERMOSTAT_STATE_T published_state = {};
+    // The state read by core 0, updated on core 1 after every change
+    Seqlock<THERMOSTAT_STATE_T> snapshot;
 
     double target_temperature = 10;
     bool winter_mode = false;
@@ -120,7 +152,6 @@ class Thermostat {
     /** Display **/
 
     void update_temperature() {
-      mutex_enter_blocking(&this->m_read_temp);
       printf("[Thermostat] Updating temperature\n");
       const float conversion_factor = 3.3f / (1 << 12);
 
@@ -129,27 +160,42 @@ class Thermostat {
 
       this->temperature = std::ceil((temp + TEMPERATURE_CORRECTION) * 10.0) / 10.0;
       printf("[Thermostat] Temperature: %f - %f\n", this->temperature, temp);
-      mutex_exit(&this->m_read_temp);
     }
 
-    static bool check(struct repeating_timer *rt) {
-      try {
-        Thermostat *instance = static_cast<Thermostat*>(rt->user_data);
+    void update_heating() {
+      if (!this->get_winter_mode()) {
+        this->heating = false;
+      } else if (!this->heating) {
+        if (this->temperature < this->target_temperature) {
+          this->heating = true;
+        }
+      } else if (this->temperature >= (this->target_temperature + 1)) {
+        this->heating = false;
+      }
+    }
 
-        if (instance->show_target_temp) {
-          if (instance->target_timeout <= 0) {
-            instance->show_target_temp = false;
+    void check() {
+      try {
+        if (this->show_target_temp) {
+          if (this->target_timeout <= 0) {
+            this->show_target_temp = false;
           } else {
-            instance->target_timeout--;
+            this->target_timeout--;
           }
         }
 
-        const bool heating = instance->is_heating();
-        gpio_put(RELAY_GPIO_PIN, heating);
-        instance->trigger_display_update(heating);
+        this->update_heating();
+        gpio_put(RELAY_GPIO_PIN, this->heating);
+        this->trigger_display_update(this->heating);
+        this->publish_state();
       } catch (...) {
         printf("[Thermostat]:[ERROR]: While checking the heating mode\n");
       }
+    }
+
+    static bool check_timer_callback(struct repeating_timer *rt) {
+      Thermostat *instance = static_cast<Thermostat*>(rt->user_data);
+      instance->check_triggered = true;
 
       return true;
     }
@@ -162,8 +208,6 @@ class Thermostat {
     }
   public:
     Thermostat() {
-      mutex_init(&this->m_read_temp);
-      mutex_init(&this->m_heating);
       mutex_init(&this->m_t_display);
 
       gpio_init(PLUS_TEMP_GPIO_PIN);
@@ -186,11 +230,43 @@ class Thermostat {
       this->display.center_message(message, freeze);
     }
 
+    /**
+     * Stores the state read by core 0, it's published on the event bus only when it changed
+     */
+    void publish_state() {
+      const THERMOSTAT_STATE_T state = {
+        this->target_temperature,
+        this->temperature,
+        this->is_celsius,
+        this->winter_mode,
+        this->humidity,
+        this->heating
+      };
+
+      this->snapshot.store(state);
+
+      if (
+        state.target_temperature == this->published_state.target_temperature &&
+        state.temperature == this->published_state.temperature &&
+        state.celsius == this->published_state.celsius &&
+        state.winter == this->published_state.winter &&
+        state.humidity == this->published_state.humidity &&
+        state.heating == this->published_state.heating
+      ) {
+        return;
+      }
+
+      this->published_state = state;
+      thermostat_state_topic.publish(state);
+    }
+
     void ready() {
       this->display.setup();
       this->update_temperature();
+      this->update_heating();
+      this->publish_state();
 
-      add_repeating_timer_ms(1000, Thermostat::check, this, &this->timer);
+      add_repeating_timer_ms(1000, Thermostat::check_timer_callback, this, &this->timer);
       add_alarm_in_ms(TRIGGER_INTERVAL_MS, alarm_callback, this, false);
 
       _ready = true;
@@ -206,6 +282,7 @@ class Thermostat {
         if (!this->button_pressed) {
           this->button_pressed = true;
           this->set_target_temperature(this->target_temperature + 0.5);
+          this->publish_state();
           this->target_timeout = 5;
           this->show_target_temp = true;
           this->trigger_display_update(false);
@@ -216,6 +293,7 @@ class Thermostat {
         if (!this->button_pressed) {
           this->button_pressed = true;
           this->set_target_temperature(this->target_temperature - 0.5);
+          this->publish_state();
           this->target_timeout = 5;
           this->show_target_temp = true;
           this->trigger_display_update(false);
@@ -229,6 +307,12 @@ class Thermostat {
       if (this->alarm_triggered) {
         this->alarm_triggered = false;
         this->update_temperature();
+        this->publish_state();
+      }
+
+      if (this->check_triggered) {
+        this->check_triggered = false;
+        this->check();
       }
     }
 
@@ -284,68 +368,82 @@ class Thermostat {
     }
 
     bool is_heating() {
-      mutex_enter_blocking(&this->m_heating);
-
-      if (!this->get_winter_mode()) {
-        this->prev_heating = false;
-      } else {
-        if (!this->prev_heating) {
-          if (this->temperature < this->target_temperature) {
-            this->prev_heating = true;
-          }
-        } else {
-          if (this->temperature >= (this->target_temperature + 1)) {
-            this->prev_heating = false;
-          }
-        }
-      }
+      return this->heating;
+    }
 
-      mutex_exit(&this->m_heating);
-      return this->prev_heating;
+    /**
+     * Called on core 0, returns false before the service is ready
+     */
+    bool load_state(THERMOSTAT_STATE_T &state) const {
+      return this->snapshot.load(state);
     }
 };
 
 Thermostat service = Thermostat();
 
-json service_handle_packet(const json &body, const PACKET_TYPE &type) {
-  if (!service.is_ready()) {
+typedef struct THERMOSTAT_COMMAND_T_ {
+  bool has_target_temperature;
+  double target_temperature;
+  bool has_celsius;
+  bool celsius;
+  bool has_winter;
+  bool winter;
+} THERMOSTAT_COMMAND_T;
+
+CommandQueue<THERMOSTAT_COMMAND_T> service_commands;
+
+json service_get_data() {
+  THERMOSTAT_STATE_T state;
+  if (!service.load_state(state)) {
     return {};
   }
 
-  switch (type) {
-    case PACKET_TYPE::GET:
-      break;
-    case PACKET_TYPE::SET: {
-      double target_temperature = body.value(
-        "target_temperature", 
-        service.get_target_temperature()
-      );
-      bool celsius = body.value(
-        "celsius",
-        service.get_is_celsius()
-      );
-      bool winter = body.value(
-        "winter",
-        service.get_winter_mode()
-      );
+  return state;
+}
 
-      service.set_target_temperature(target_temperature);
-      service.set_is_celsius(celsius);
-      service.set_winter_mode(winter);
-      break;
-    }
-    default:
-      return {};
+/**
+ * Called on core 0 for a SET packet, returns the token of the command or 0 if the queue is full
+ */
+uint32_t service_submit_command(const json &body) {
+  THERMOSTAT_COMMAND_T command = {};
+
+  if (body.contains("target_temperature")) {
+    command.has_target_temperature = true;
+    command.target_temperature = body["target_temperature"].get<double>();
   }
 
-  return {
-    {"target_temperature", service.get_target_temperature()},
-    {"temperature", service.get_temperature()},
-    {"celsius", service.get_is_celsius()},
-    {"winter", service.get_winter_mode()},
-    {"humidity", service.get_humidity()},
-    {"heating", service.is_heating()}
-  };
+  if (body.contains("celsius")) {
+    command.has_celsius = true;
+    command.celsius = body["celsius"].get<bool>();
+  }
+
+  if (body.contains("winter")) {
+    command.has_winter = true;
+    command.winter = body["winter"].get<bool>();
+  }
+
+  return service_commands.submit(command);
+}
+
+/**
+ * Called from the loop on core 1
+ */
+void service_run_commands() {
+  service_commands.process([] (const THERMOSTAT_COMMAND_T &command) {
+    if (command.has_target_temperature) {
+      service.set_target_temperature(command.target_temperature);
+    }
+
+    if (command.has_celsius) {
+      service.set_is_celsius(command.celsius);
+    }
+
+    if (command.has_winter) {
+      service.set_winter_mode(command.winter);
+    }
+
+    service.publish_state();
+  });
 }
 
 #endif
\ No newline at end of file
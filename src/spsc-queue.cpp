@@ -0,0 +1,58 @@
+#include "hardware/sync.h"
+#include <type_traits>
+#include <stdint.h>
+
+#ifndef __SPSC_QUEUE_CPP__
+#define __SPSC_QUEUE_CPP__
+
+/**
+ * Lock-free ring of `N` values for one producer and one consumer, they can
+ * run on different cores. The indexes only grow, so the ring is full when
+ * they are `N` apart.
+ */
+template <typename T, uint8_t N>
+class SpscQueue {
+  static_assert(std::is_trivially_copyable<T>::value, "The values must be trivially copyable");
+
+  private:
+    volatile uint32_t head = 0;
+    volatile uint32_t tail = 0;
+    T values[N];
+
+  public:
+    /**
+     * Called by the producer, returns false if the queue is full
+     */
+    bool push(const T &value) {
+      const uint32_t head = this->head;
+
+      if (head - this->tail >= N) {
+        return false;
+      }
+
+      this->values[head % N] = value;
+      __dmb();
+      this->head = head + 1;
+
+      return true;
+    }
+
+    /**
+     * Called by the consumer, returns false if the queue is empty
+     */
+    bool pop(T &value) {
+      const uint32_t tail = this->tail;
+      if (tail == this->head) {
+        return false;
+      }
+
+      __dmb();
+      value = this->values[tail % N];
+      __dmb();
+      this->tail = tail + 1;
+
+      return true;
+    }
+};
+
+#endif
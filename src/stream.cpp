@@ -0,0 +1,422 @@
+#include <stdint.h>
+#include <string.h>
+#include <optional>
+#include <string>
+
+#include "./config.h"
+#include "./server-utils.cpp"
+#include "./json-stream.cpp"
+#include "./frame.cpp"
+
+#ifndef INCLUDE_NLOHMANN_JSON_HPP_
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+#endif
+
+#ifndef __STREAM_CPP__
+#define __STREAM_CPP__
+
+#ifndef TCP_SERVER_MAX_STREAM_SIZE
+#define TCP_SERVER_MAX_STREAM_SIZE 32768
+#endif
+
+/* #region Base64 */
+
+typedef struct BASE64_STREAM_T_ {
+  uint32_t bits = 0;
+  uint8_t count = 0;
+  bool padding = false;
+} BASE64_STREAM_T;
+
+static int8_t base64_stream_value(const uint8_t &c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+' || c == '-') return 62;
+  if (c == '/' || c == '_') return 63;
+  return -1;
+}
+
+static size_t base64_stream_flush(BASE64_STREAM_T *state, uint8_t *output) {
+  size_t written = 0;
+
+  if (state->count == 2) {
+    output[written++] = (uint8_t)(state->bits >> 4);
+  } else if (state->count == 3) {
+    output[written++] = (uint8_t)(state->bits >> 10);
+    output[written++] = (uint8_t)(state->bits >> 2);
+  }
+
+  state->bits = 0;
+  state->count = 0;
+  return written;
+}
+
+/**
+ * Decodes base64 in any chunking, `output` must hold at least `len * 3 / 4 + 2` bytes.
+ * Returns -1 when the input is not valid base64.
+ */
+int base64_stream_decode(BASE64_STREAM_T *state, const uint8_t *input, const size_t &len, uint8_t *output) {
+  size_t written = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    if (input[i] == '=' || input[i] == '.') {
+      if (!state->padding && state->count < 2) {
+        return -1;
+      }
+
+      written += base64_stream_flush(state, output + written);
+      state->padding = true;
+      continue;
+    }
+
+    const int8_t value = base64_stream_value(input[i]);
+    if (value < 0 || state->padding) {
+      return -1;
+    }
+
+    state->bits = (state->bits << 6) | value;
+    if (++state->count == 4) {
+      output[written++] = (uint8_t)(state->bits >> 16);
+      output[written++] = (uint8_t)(state->bits >> 8);
+      output[written++] = (uint8_t)state->bits;
+      state->bits = 0;
+      state->count = 0;
+    }
+  }
+
+  return written;
+}
+
+/**
+ * Flushes an unpadded tail, returns -1 if the input was truncated
+ */
+int base64_stream_end(BASE64_STREAM_T *state, uint8_t *output) {
+  if (state->count == 1) {
+    return -1;
+  }
+
+  return base64_stream_flush(state, output);
+}
+
+/* #endregion */
+
+/**
+ * SAX consumer for a streamed packet, the `type` and `id` are read from
+ * the top level object and the `body` is built as it is received.
+ *
+ * The `type` has to be sent before the `body` in streamed packets.
+ */
+class PacketSax : public nlohmann::json_sax<json> {
+  private:
+    std::optional<nlohmann::detail::json_sax_dom_parser<json>> body_parser;
+    uint8_t body_depth = 0;
+    bool in_body = false;
+
+    uint8_t skip_depth = 0;
+    uint8_t depth = 0;
+    std::string key_name;
+
+    bool top_level_value() {
+      return this->depth == 1 && !this->in_body && this->skip_depth == 0;
+    }
+
+    bool begin_value() {
+      if (this->top_level_value() && this->key_name == "body") {
+        if (this->type.empty()) {
+          return false;
+        }
+
+        this->in_body = true;
+        this->body_depth = 0;
+      }
+
+      return true;
+    }
+
+    void end_body_value() {
+      if (this->in_body && this->body_depth == 0) {
+        this->in_body = false;
+      }
+    }
+
+    template <typename Fn>
+    bool scalar(Fn forward) {
+      if (this->depth == 0 || !this->begin_value()) {
+        return false;
+      }
+
+      if (this->in_body) {
+        const bool result = forward();
+        this->end_body_value();
+        return result;
+      }
+
+      return true;
+    }
+
+  public:
+    std::string type;
+    std::string id;
+    json body;
+
+    void reset() {
+      this->body = json();
+      this->body_parser.emplace(this->body, false);
+      this->body_depth = 0;
+      this->in_body = false;
+      this->skip_depth = 0;
+      this->depth = 0;
+      this->key_name.clear();
+      this->type.clear();
+      this->id.clear();
+    }
+
+    bool null() override {
+      return this->scalar([this] () { return this->body_parser->null(); });
+    }
+
+    bool boolean(bool val) override {
+      return this->scalar([this, val] () { return this->body_parser->boolean(val); });
+    }
+
+    bool number_integer(number_integer_t val) override {
+      return this->scalar([this, val] () { return this->body_parser->number_integer(val); });
+    }
+
+    bool number_unsigned(number_unsigned_t val) override {
+      return this->scalar([this, val] () { return this->body_parser->number_unsigned(val); });
+    }
+
+    bool number_float(number_float_t val, const string_t& s) override {
+      return this->scalar([this, val, &s] () { return this->body_parser->number_float(val, s); });
+    }
+
+    bool string(string_t& val) override {
+      if (this->top_level_value()) {
+        if (this->key_name == "type") {
+          this->type = val;
+        } else if (this->key_name == "id") {
+          this->id = val;
+        }
+      }
+
+      return this->scalar([this, &val] () { return this->body_parser->string(val); });
+    }
+
+    bool binary(binary_t& val) override {
+      return false;
+    }
+
+    bool start_object(std::size_t elements) override {
+      if (this->depth == 0) {
+        this->depth = 1;
+        return true;
+      }
+
+      return this->start_container([this, elements] () { return this->body_parser->start_object(elements); });
+    }
+
+    bool key(string_t& val) override {
+      if (this->in_body) {
+        return this->body_parser->key(val);
+      }
+
+      if (this->top_level_value()) {
+        this->key_name = val;
+      }
+
+      return true;
+    }
+
+    bool end_object() override {
+      return this->end_container([this] () { return this->body_parser->end_object(); });
+    }
+
+    bool start_array(std::size_t elements) override {
+      if (this->depth == 0) {
+        return false;
+      }
+
+      return this->start_container([this, elements] () { return this->body_parser->start_array(elements); });
+    }
+
+    bool end_array() override {
+      return this->end_container([this] () { return this->body_parser->end_array(); });
+    }
+
+    bool parse_error(std::size_t position, const std::string& last_token, const nlohmann::detail::exception& ex) override {
+      return false;
+    }
+
+  private:
+    template <typename Fn>
+    bool start_container(Fn forward) {
+      if (!this->begin_value()) {
+        return false;
+      }
+
+      if (this->in_body) {
+        this->body_depth++;
+        return forward();
+      }
+
+      this->skip_depth++;
+      return true;
+    }
+
+    template <typename Fn>
+    bool end_container(Fn forward) {
+      if (this->in_body) {
+        this->body_depth--;
+        const bool result = forward();
+        this->end_body_value();
+        return result;
+      }
+
+      if (this->skip_depth > 0) {
+        this->skip_depth--;
+      } else {
+        this->depth--;
+      }
+
+      return true;
+    }
+};
+
+/**
+ * Streams a frame larger than TCP_SERVER_BUF_SIZE through base64 decoding,
+ * AES-CTR decryption and the JSON push parser, the frame text is never held
+ * in memory but the `body` is built as a JSON value for the handler, so it
+ * still takes memory in proportion to its size (up to TCP_SERVER_MAX_STREAM_SIZE).
+ * A string or number longer than JSON_STREAM_MAX_TOKEN bytes rejects the packet.
+ *
+ * There is a single stream shared by all the clients, while one client is
+ * uploading a large frame the large frames from other clients are rejected.
+ */
+class PacketStream : public FrameStream {
+  private:
+    const void *owner = nullptr;
+    JsonStream parser;
+    PacketSax sax;
+    bool failed = false;
+
+#ifdef AES_ENCRYPTION_KEY
+    BASE64_STREAM_T base64;
+    // A stream is decrypted across several segments, so it has its own context
+    AesCtr ctr;
+    uint8_t iv[16];
+    uint8_t iv_len = 0;
+
+    bool decrypt(uint8_t *data, size_t len) {
+      if (this->iv_len < 16) {
+        const size_t chunk = len < (size_t)(16 - this->iv_len) ? len : 16 - this->iv_len;
+        memcpy(this->iv + this->iv_len, data, chunk);
+        this->iv_len += chunk;
+        data += chunk;
+        len -= chunk;
+
+        if (this->iv_len == 16) {
+          this->ctr.setIV(this->iv, 16);
+        }
+      }
+
+      if (len == 0) {
+        return true;
+      }
+
+      this->ctr.decrypt(data, len);
+      return this->parser.write(data, len);
+    }
+#endif
+
+  public:
+    uint32_t max_size() override {
+      return TCP_SERVER_MAX_STREAM_SIZE;
+    }
+
+    bool begin(const void *owner, const uint32_t &len) override {
+      if (this->owner != nullptr && this->owner != owner) {
+        printf("[Stream] Busy, rejecting a frame of %u bytes\n", len);
+        return false;
+      }
+
+      printf("[Stream] Receiving a frame of %u bytes\n", len);
+
+      this->owner = owner;
+      this->failed = false;
+      this->sax.reset();
+      this->parser.reset(&this->sax);
+
+#ifdef AES_ENCRYPTION_KEY
+      this->base64 = BASE64_STREAM_T();
+      this->iv_len = 0;
+#endif
+
+      return true;
+    }
+
+    bool write(const uint8_t *data, const size_t &len) override {
+      if (this->failed) {
+        return false;
+      }
+
+#ifdef AES_ENCRYPTION_KEY
+      uint8_t decoded[50];
+      size_t offset = 0;
+
+      while (offset < len) {
+        const size_t chunk = len - offset > 64 ? 64 : len - offset;
+        const int written = base64_stream_decode(&this->base64, data + offset, chunk, decoded);
+
+        if (written < 0 || !this->decrypt(decoded, written)) {
+          this->failed = true;
+          return false;
+        }
+
+        offset += chunk;
+      }
+
+      return true;
+#else
+      this->failed = !this->parser.write(data, len);
+      return !this->failed;
+#endif
+    }
+
+    /**
+     * Finishes the frame, returns false if it wasn't a valid packet
+     */
+    bool end() {
+      if (this->failed) {
+        return false;
+      }
+
+#ifdef AES_ENCRYPTION_KEY
+      uint8_t decoded[2];
+      const int written = base64_stream_end(&this->base64, decoded);
+
+      if (written < 0 || this->iv_len < 16 || !this->decrypt(decoded, written)) {
+        return false;
+      }
+#endif
+
+      return this->parser.end() && !this->sax.type.empty();
+    }
+
+    void release(const void *owner) override {
+      if (this->owner == owner) {
+        this->owner = nullptr;
+        this->sax.reset();
+      }
+    }
+
+    PacketSax& packet() {
+      return this->sax;
+    }
+};
+
+PacketStream packet_stream;
+
+#endif
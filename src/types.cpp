@@ -8,8 +8,10 @@ enum class PACKET_TYPE {
   INFO,
   SET,
   GET,
+  SUBSCRIBE,
 
   ERROR,
+  DELTA,
 
   UNKNOWN
 };
@@ -24,14 +26,18 @@ std::string PACKET_TYPES(const PACKET_TYPE& command) {
       return "PING";
     case PACKET_TYPE::INFO:
       return "INFO";
+    case PACKET_TYPE::SUBSCRIBE:
+      return "SUBSCRIBE";
     case PACKET_TYPE::ERROR:
       return "ERROR";
+    case PACKET_TYPE::DELTA:
+      return "DELTA";
     default:
       return "";
   }
 }
 
-// The ERROR packet can't be received by the server, but it can be sent by the server to the client.
+// The ERROR and DELTA packets can't be received by the server, but they can be sent by the server to the client.
 PACKET_TYPE packet_type_from_string(const std::string& value) {
   if (value == "SET") {
     return PACKET_TYPE::SET;
@@ -49,6 +55,10 @@ PACKET_TYPE packet_type_from_string(const std::string& value) {
     return PACKET_TYPE::INFO;
   }
 
+  if (value == "SUBSCRIBE") {
+    return PACKET_TYPE::SUBSCRIBE;
+  }
+
   return PACKET_TYPE::UNKNOWN;
 }
 
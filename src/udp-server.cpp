@@ -0,0 +1,298 @@
+#include "pico/cyw43_arch.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include <string_view>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+
+#include "./config.h"
+#include "./buffer-pool.cpp"
+#include "./server-utils.cpp"
+#include "./handler.cpp"
+#include "./frame.cpp"
+#include "./peer.cpp"
+#include "./stream.cpp"
+#include "./clock.cpp"
+
+#ifndef __UDP_SERVER_CPP__
+#define __UDP_SERVER_CPP__
+
+#ifdef UDP_SERVER_PORT
+
+/**
+ * Optional UDP endpoint, every datagram holds one `number_of_characters;data`
+ * frame and the reply is sent back as one datagram to the same address.
+ *
+ * Nothing is retransmitted, a client matches the replies by the packet `id`
+ * and sends the request again if it gets no reply. Frames larger than
+ * TCP_SERVER_BUF_SIZE are not streamed and the events are not pushed.
+ */
+static struct udp_pcb *udp_server_pcb = NULL;
+
+#ifndef UDP_SERVER_RATE_LIMIT
+#define UDP_SERVER_RATE_LIMIT 20
+#endif
+
+#ifndef UDP_SERVER_RATE_SOURCES
+#define UDP_SERVER_RATE_SOURCES 8
+#endif
+
+#ifndef UDP_SERVER_REPLAY_WINDOW
+#define UDP_SERVER_REPLAY_WINDOW 16
+#endif
+
+#ifndef UDP_SERVER_REPLAY_SOURCES
+#define UDP_SERVER_REPLAY_SOURCES 8
+#endif
+
+/* #region Rate limit */
+
+/**
+ * A token bucket per source address, refilled with UDP_SERVER_RATE_LIMIT
+ * datagrams per second up to one second of burst. Only the last
+ * UDP_SERVER_RATE_SOURCES addresses are tracked, a new address takes
+ * the slot of the one heard from least recently.
+ */
+typedef struct UDP_RATE_SOURCE_T_ {
+  bool used = false;
+  ip_addr_t addr;
+  uint64_t last_ms = 0;
+  // In thousandths of a datagram
+  uint32_t credit = 0;
+} UDP_RATE_SOURCE_T;
+
+static UDP_RATE_SOURCE_T udp_rate_sources[UDP_SERVER_RATE_SOURCES];
+
+static bool udp_server_rate_allow(const ip_addr_t *addr) {
+  const uint64_t now = clock_ms();
+  const uint32_t max_credit = UDP_SERVER_RATE_LIMIT * 1000;
+  UDP_RATE_SOURCE_T *source = NULL;
+
+  for (uint8_t i = 0; i < UDP_SERVER_RATE_SOURCES; i++) {
+    UDP_RATE_SOURCE_T *candidate = &udp_rate_sources[i];
+
+    if (candidate->used && ip_addr_cmp(&candidate->addr, addr)) {
+      source = candidate;
+      break;
+    }
+
+    if (source == NULL || !candidate->used || (source->used && candidate->last_ms < source->last_ms)) {
+      source = candidate;
+    }
+  }
+
+  if (!source->used || !ip_addr_cmp(&source->addr, addr)) {
+    source->used = true;
+    ip_addr_copy(source->addr, *addr);
+    source->credit = max_credit;
+  } else {
+    const uint64_t elapsed = now - source->last_ms;
+    source->credit = elapsed >= 1000 ? max_credit : std::min<uint32_t>(max_credit, source->credit + elapsed * UDP_SERVER_RATE_LIMIT);
+  }
+
+  source->last_ms = now;
+
+  if (source->credit < 1000) {
+    return false;
+  }
+
+  source->credit -= 1000;
+  return true;
+}
+
+/* #endregion */
+
+/* #region Replay window */
+
+#ifdef AES_ENCRYPTION_KEY
+
+/**
+ * The IVs of the last UDP_SERVER_REPLAY_WINDOW valid packets of a source,
+ * every request has a random IV so a packet with an IV seen from any source
+ * is a replay. A request the client retries is encrypted again with a new IV.
+ *
+ * The IVs are only recorded once the packet is decrypted and parsed, so the
+ * windows can't be flushed without the key, and a source only evicts its own
+ * IVs. A new source takes the slot of the one heard from least recently.
+ */
+typedef struct UDP_REPLAY_SOURCE_T_ {
+  bool used = false;
+  ip_addr_t addr;
+  uint64_t last_ms = 0;
+  uint8_t ivs[UDP_SERVER_REPLAY_WINDOW][16];
+  uint8_t count = 0;
+  uint8_t next = 0;
+} UDP_REPLAY_SOURCE_T;
+
+static UDP_REPLAY_SOURCE_T udp_replay_sources[UDP_SERVER_REPLAY_SOURCES];
+
+/**
+ * Reads the IV from the start of the base64 data, 24 characters hold its 16 bytes
+ */
+static bool udp_server_frame_iv(const std::string_view &frame, uint8_t *iv) {
+  if (frame.size() < 24) {
+    return false;
+  }
+
+  BASE64_STREAM_T base64;
+  uint8_t decoded[20];
+  if (base64_stream_decode(&base64, (const uint8_t*)frame.data(), 24, decoded) < 16) {
+    return false;
+  }
+
+  memcpy(iv, decoded, 16);
+  return true;
+}
+
+static bool udp_server_replayed(const uint8_t *iv) {
+  for (uint8_t i = 0; i < UDP_SERVER_REPLAY_SOURCES; i++) {
+    const UDP_REPLAY_SOURCE_T *source = &udp_replay_sources[i];
+
+    for (uint8_t j = 0; source->used && j < source->count; j++) {
+      if (memcmp(source->ivs[j], iv, 16) == 0) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Adds the IV of a valid packet to the window of its source
+ */
+static void udp_server_record_iv(const ip_addr_t *addr, const uint8_t *iv) {
+  UDP_REPLAY_SOURCE_T *source = NULL;
+
+  for (uint8_t i = 0; i < UDP_SERVER_REPLAY_SOURCES; i++) {
+    UDP_REPLAY_SOURCE_T *candidate = &udp_replay_sources[i];
+
+    if (candidate->used && ip_addr_cmp(&candidate->addr, addr)) {
+      source = candidate;
+      break;
+    }
+
+    if (source == NULL || !candidate->used || (source->used && candidate->last_ms < source->last_ms)) {
+      source = candidate;
+    }
+  }
+
+  if (!source->used || !ip_addr_cmp(&source->addr, addr)) {
+    source->used = true;
+    ip_addr_copy(source->addr, *addr);
+    source->count = 0;
+    source->next = 0;
+  }
+
+  source->last_ms = clock_ms();
+
+  memcpy(source->ivs[source->next], iv, 16);
+  source->next = (source->next + 1) % UDP_SERVER_REPLAY_WINDOW;
+  if (source->count < UDP_SERVER_REPLAY_WINDOW) {
+    source->count++;
+  }
+}
+
+#endif
+
+/* #endregion */
+
+/**
+ * Decrypts and handles the frame of a datagram, with encryption the packets
+ * with an IV in the replay windows are dropped
+ */
+static void udp_server_handle_frame(const PEER_T *peer, const std::string_view &frame) {
+#ifdef AES_ENCRYPTION_KEY
+  uint8_t iv[16];
+  if (!udp_server_frame_iv(frame, iv)) {
+    printf("[UDP-Server] Malformed datagram from %s\n", peer->id);
+    return;
+  }
+
+  const std::string decrypted = decrypt_256_aes_ctr(frame);
+  std::string packet_id = "";
+  std::string s_type = "";
+  json body = {};
+
+  if (decrypted == "" || !handle_parse_packet(peer, decrypted, s_type, packet_id, body)) {
+    return;
+  }
+
+  if (udp_server_replayed(iv)) {
+    printf("[UDP-Server] Replayed datagram from %s\n", peer->id);
+    return;
+  }
+
+  udp_server_record_iv(&peer->addr, iv);
+  handle_client_packet(peer, s_type, packet_id, body);
+#else
+  handle_client_frame(peer, frame);
+#endif
+}
+
+static void udp_server_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+  if (p == NULL) {
+    return;
+  }
+
+  const PEER_T peer = peer_from_udp(static_cast<TCP_SERVER_T*>(arg), pcb, addr, port);
+
+  if (!udp_server_rate_allow(addr)) {
+    printf("[UDP-Server] Rate limited, dropping the datagram from %s\n", peer.id);
+    pbuf_free(p);
+    return;
+  }
+
+  uint8_t *buffer = buffer_pool_acquire();
+  if (buffer == NULL) {
+    printf("[UDP-Server] No free buffer, dropping the datagram from %s\n", peer.id);
+    pbuf_free(p);
+    return;
+  }
+
+  FRAME_DECODER_T decoder;
+  const uint16_t used = frame_decoder_feed_pbuf(&decoder, buffer, TCP_SERVER_BUF_SIZE, nullptr, p, 0);
+  const bool complete = decoder.state == FRAME_STATE::COMPLETE && used == p->tot_len;
+  pbuf_free(p);
+
+  if (complete) {
+    udp_server_handle_frame(&peer, std::string_view((char*)buffer, decoder.packet_len));
+  } else {
+    printf("[UDP-Server] Malformed datagram from %s\n", peer.id);
+  }
+
+  buffer_pool_release(buffer);
+}
+
+static bool udp_server_open(TCP_SERVER_T *state) {
+  printf("[UDP-Server] Starting (%s:%u)\n", ip4addr_ntoa(netif_ip4_addr(netif_list)), UDP_SERVER_PORT);
+
+  cyw43_arch_lwip_begin();
+
+  udp_server_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+  if (!udp_server_pcb) {
+    cyw43_arch_lwip_end();
+    printf("[UDP-Server] Failed to create pcb\n");
+    return false;
+  }
+
+  if (udp_bind(udp_server_pcb, NULL, UDP_SERVER_PORT) != ERR_OK) {
+    udp_remove(udp_server_pcb);
+    udp_server_pcb = NULL;
+
+    cyw43_arch_lwip_end();
+    printf("[UDP-Server] Failed to bind to port %u\n", UDP_SERVER_PORT);
+    return false;
+  }
+
+  udp_recv(udp_server_pcb, udp_server_recv, state);
+
+  cyw43_arch_lwip_end();
+  printf("[UDP-Server] Successfully started\n");
+  return true;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+#include <string.h>
+
+#include "./test-utils.cpp"
+#include "aes-ctr.cpp"
+
+static const size_t BLOCKS = 400000;
+
+/**
+ * Encrypts a block over and over, every block depends on the previous one
+ * so the rounds of several blocks can't overlap. Returns the ns per block.
+ */
+template <typename Cipher>
+static double bench_block(const char *name, const double &reference_ns = 0) {
+  uint8_t key[32];
+  for (uint8_t i = 0; i < sizeof(key); i++) {
+    key[i] = i;
+  }
+
+  Cipher cipher;
+  cipher.setKey(key, sizeof(key));
+
+  uint8_t block[16] = {};
+  const double ns = bench_ns(BLOCKS, [&] (const size_t &i) {
+    cipher.encryptBlock(block, block);
+  });
+
+  bench_sink += block[0];
+  printf("[Bench] %-22s %7.1f ns/block  %5.2fx\n", name, ns, reference_ns > 0 ? reference_ns / ns : 1.0);
+  return ns;
+}
+
+/**
+ * Encrypts a 1 KB buffer with encryptBlocks, the blocks are independent
+ * like the keystream blocks of CTR. Returns the ns per block.
+ */
+template <typename Cipher>
+static double bench_blocks(const char *name, const double &reference_ns = 0) {
+  uint8_t key[32] = {};
+  Cipher cipher;
+  cipher.setKey(key, sizeof(key));
+
+  static uint8_t buffer[1024];
+  const size_t count = sizeof(buffer) / 16;
+
+  const double ns = bench_ns(BLOCKS / count, [&] (const size_t &i) {
+    cipher.encryptBlocks(buffer, buffer, count);
+  }) / count;
+
+  bench_sink += buffer[0];
+  printf("[Bench] %-22s %7.1f ns/block  %5.2fx\n", name, ns, reference_ns > 0 ? reference_ns / ns : 1.0);
+  return ns;
+}
+
+int main() {
+  printf("[Bench] AES-256 encryptBlock, AES_FAST_TABLES %d\n", AES_FAST_TABLES);
+
+  const double reference_ns = bench_block<AES256>("AES256");
+  bench_block<AesFast256>("AesFast256", reference_ns);
+  bench_block<AesSliced256>("AesSliced256", reference_ns);
+
+  printf("[Bench] AES-256 encryptBlocks, 64 blocks per call\n");
+
+  const double blocks_reference_ns = bench_blocks<AES256>("AES256");
+  bench_blocks<AesFast256>("AesFast256", blocks_reference_ns);
+  bench_blocks<AesSliced256>("AesSliced256 (pairs)", blocks_reference_ns);
+
+  return 0;
+}
@@ -0,0 +1,176 @@
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "./test-utils.cpp"
+#include "aes-ctr.cpp"
+
+typedef struct AES_VECTOR_T_ {
+  const char *key;
+  const char *plaintext;
+  const char *ciphertext;
+} AES_VECTOR_T;
+
+// FIPS-197 C.3 and the AES-256 ECB vectors of SP 800-38A F.1.5
+static const AES_VECTOR_T aes_vectors[] = {
+  {
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",
+    "00112233445566778899aabbccddeeff",
+    "8ea2b7ca516745bfeafc49904b496089"
+  },
+  {
+    "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+    "6bc1bee22e409f96e93d7e117393172a",
+    "f3eed1bdb5d2a03c064b5a7e3db181f8"
+  },
+  {
+    "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+    "ae2d8a571e03ac9c9eb76fac45af8e51",
+    "591ccb10d410ed26dc5ba74a31362870"
+  },
+  {
+    "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+    "30c81c46a35ce411e5fbc1191a0a52ef",
+    "b6ed21b99ca6f4f9f153e7b1beafed1d"
+  },
+  {
+    "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+    "f69f2445df4f9b17ad2b417be66c3710",
+    "23304b7a39f9f3ff067d8d8f9e24ecc7"
+  }
+};
+
+static void random_bytes(uint8_t *data, const size_t &len) {
+  for (size_t i = 0; i < len; i++) {
+    data[i] = (uint8_t)rand();
+  }
+}
+
+template <typename Cipher>
+static void test_vectors() {
+  for (const AES_VECTOR_T &vector : aes_vectors) {
+    const std::vector<uint8_t> key = test_hex(vector.key);
+    const std::vector<uint8_t> plaintext = test_hex(vector.plaintext);
+    const std::vector<uint8_t> ciphertext = test_hex(vector.ciphertext);
+    uint8_t output[16];
+
+    Cipher cipher;
+    TEST_CHECK(cipher.setKey(key.data(), key.size()));
+
+    cipher.encryptBlock(output, plaintext.data());
+    TEST_CHECK(memcmp(output, ciphertext.data(), 16) == 0);
+
+    // In place
+    memcpy(output, plaintext.data(), 16);
+    cipher.encryptBlock(output, output);
+    TEST_CHECK(memcmp(output, ciphertext.data(), 16) == 0);
+
+    // The decryption of AES256 is kept
+    cipher.decryptBlock(output, ciphertext.data());
+    TEST_CHECK(memcmp(output, plaintext.data(), 16) == 0);
+  }
+}
+
+/**
+ * Random keys and blocks against the byte oriented AES256
+ */
+template <typename Cipher>
+static void test_random() {
+  srand(1);
+
+  for (int i = 0; i < 2000; i++) {
+    uint8_t key[32];
+    uint8_t input[16];
+    uint8_t expected[16];
+    uint8_t output[16];
+
+    random_bytes(key, sizeof(key));
+    random_bytes(input, sizeof(input));
+
+    AES256 reference;
+    reference.setKey(key, sizeof(key));
+    reference.encryptBlock(expected, input);
+
+    Cipher cipher;
+    cipher.setKey(key, sizeof(key));
+    cipher.encryptBlock(output, input);
+
+    TEST_CHECK(memcmp(output, expected, 16) == 0);
+  }
+}
+
+/**
+ * Keyed from the schedule expanded at compile time
+ */
+template <typename Cipher>
+static void test_schedule() {
+  const std::string key = base64_decode(std::string(AES_ENCRYPTION_KEY));
+  uint8_t input[16];
+  uint8_t expected[16];
+  uint8_t output[16];
+
+  random_bytes(input, sizeof(input));
+
+  AES256 reference;
+  reference.setKey((const uint8_t*)key.data(), key.size());
+  reference.encryptBlock(expected, input);
+
+  Cipher cipher;
+  TEST_CHECK(cipher.setSchedule(aes_key_schedule.data(), aes_key_schedule.size()));
+  TEST_CHECK(!cipher.setSchedule(aes_key_schedule.data(), aes_key_schedule.size() - 1));
+
+  cipher.encryptBlock(output, input);
+  TEST_CHECK(memcmp(output, expected, 16) == 0);
+}
+
+/**
+ * Several blocks at once, in pairs and with an odd block at the end
+ */
+template <typename Cipher>
+static void test_blocks() {
+  uint8_t key[32];
+  uint8_t input[16 * 7];
+  uint8_t expected[16 * 7];
+  uint8_t output[16 * 7];
+
+  random_bytes(key, sizeof(key));
+  random_bytes(input, sizeof(input));
+
+  AES256 reference;
+  reference.setKey(key, sizeof(key));
+  for (uint8_t i = 0; i < 7; i++) {
+    reference.encryptBlock(expected + i * 16, input + i * 16);
+  }
+
+  Cipher cipher;
+  cipher.setKey(key, sizeof(key));
+
+  for (uint8_t count = 0; count <= 7; count++) {
+    memset(output, 0, sizeof(output));
+    cipher.encryptBlocks(output, input, count);
+
+    TEST_CHECK(memcmp(output, expected, count * 16) == 0);
+    TEST_CHECK(count == 7 || output[count * 16] == 0);
+  }
+
+  memcpy(output, input, sizeof(output));
+  cipher.encryptBlocks(output, output, 7);
+  TEST_CHECK(memcmp(output, expected, sizeof(expected)) == 0);
+}
+
+int main() {
+  printf("[Test] AES_FAST_TABLES %d\n", AES_FAST_TABLES);
+
+  TEST_RUN(test_vectors<AES256>);
+  TEST_RUN(test_vectors<AesFast256>);
+  TEST_RUN(test_vectors<AesSliced256>);
+  TEST_RUN(test_random<AesFast256>);
+  TEST_RUN(test_random<AesSliced256>);
+  TEST_RUN(test_schedule<AES256>);
+  TEST_RUN(test_schedule<AesFast256>);
+  TEST_RUN(test_schedule<AesSliced256>);
+  TEST_RUN(test_blocks<AesFast256>);
+  TEST_RUN(test_blocks<AesSliced256>);
+
+  return test_result();
+}
@@ -0,0 +1,78 @@
+#include <stdint.h>
+#include <ctime>
+
+#include "./test-utils.cpp"
+#include "clock.cpp"
+
+static const size_t CALLS = 1000000;
+
+/* #region RTC clock */
+
+// The RTC registers, read as a struct copy on the host
+
+typedef struct datetime_t_ {
+  int16_t year;
+  int8_t month;
+  int8_t day;
+  int8_t dotw;
+  int8_t hour;
+  int8_t min;
+  int8_t sec;
+} datetime_t;
+
+static volatile datetime_t rtc_registers = { 2024, 5, 17, 5, 12, 30, 45 };
+
+static void rtc_get_datetime(datetime_t *dt) {
+  dt->year = rtc_registers.year;
+  dt->month = rtc_registers.month;
+  dt->day = rtc_registers.day;
+  dt->dotw = rtc_registers.dotw;
+  dt->hour = rtc_registers.hour;
+  dt->min = rtc_registers.min;
+  dt->sec = rtc_registers.sec;
+}
+
+/**
+ * The RTC wall clock the clock offset replaced
+ */
+static uint64_t rtc_datetime_ms() {
+  std::tm epoch_start = {};
+  epoch_start.tm_mday = 1;
+  epoch_start.tm_year = 1970 - 1900;
+
+  std::time_t basetime = std::mktime(&epoch_start);
+
+  datetime_t dt;
+  rtc_get_datetime(&dt);
+
+  std::tm now = {};
+  now.tm_year = dt.year - 1900;
+  now.tm_mon = dt.month - 1;
+  now.tm_mday = dt.day;
+  now.tm_hour = dt.hour;
+  now.tm_min = dt.min;
+  now.tm_sec = dt.sec;
+
+  const uint64_t ms = std::difftime(std::mktime(&now), basetime);
+  return ms * 1000;
+}
+
+/* #endregion */
+
+int main() {
+  clock_set_epoch_us(1715949045000000ull);
+
+  const double rtc_ns = bench_ns(CALLS, [] (const size_t &i) {
+    bench_sink += rtc_datetime_ms();
+  });
+
+  const double offset_ns = bench_ns(CALLS, [] (const size_t &i) {
+    bench_sink += clock_epoch_us() / 1000;
+  });
+
+  printf("[Bench] wall clock in ms\n");
+  printf("[Bench] mktime and RTC:  %7.1f ns/call, 1000 ms resolution\n", rtc_ns);
+  printf("[Bench] clock offset:    %7.1f ns/call, 1 ms resolution\n", offset_ns);
+
+  return 0;
+}
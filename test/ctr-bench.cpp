@@ -0,0 +1,63 @@
+#include <string.h>
+#include <string>
+
+#include "./test-utils.cpp"
+#include "aes-ctr.cpp"
+
+static const size_t PACKETS = 200000;
+
+/**
+ * Encrypts and decrypts a PING sized message per packet, the way
+ * encrypt_256_aes_ctr and decrypt_256_aes_ctr did before the context was kept
+ */
+static void per_packet_key(uint8_t *data, const size_t &len, const uint8_t *iv) {
+  uint8_t key[32];
+  memcpy(key, base64_decode(std::string(AES_ENCRYPTION_KEY)).c_str(), 32);
+
+  CTR<AES256> ctr;
+  ctr.clear();
+  ctr.setKey(key, 32);
+  ctr.setIV(iv, 16);
+  ctr.setCounterSize(4);
+  ctr.encrypt(data, len);
+}
+
+template <typename Fn>
+static void bench(const char *name, const size_t &len, Fn fn) {
+  uint8_t data[256] = {};
+  uint8_t iv[16] = {};
+
+  const double ns = bench_ns(PACKETS, [&] (const size_t &i) {
+    iv[15] = (uint8_t)i;
+    fn(data, len, iv);
+  });
+
+  bench_sink += data[0];
+  printf("[Bench] %-30s %8.1f ns/packet  %9.0f packets/s\n", name, ns, 1e9 / ns);
+}
+
+int main() {
+  static CTR<AES256> persistent;
+  const std::string key = base64_decode(std::string(AES_ENCRYPTION_KEY));
+  persistent.setKey((const uint8_t*)key.data(), key.size());
+  persistent.setCounterSize(4);
+
+  for (const size_t len : { 16, 72, 200 }) {
+    printf("[Bench] %zu byte messages\n", len);
+
+    bench("key setup per packet (AES256)", len, per_packet_key);
+
+    bench("persistent CTR<AES256>", len, [] (uint8_t *data, const size_t &len, const uint8_t *iv) {
+      persistent.setIV(iv, 16);
+      persistent.encrypt(data, len);
+    });
+
+    bench("aes_ctr_context", len, [] (uint8_t *data, const size_t &len, const uint8_t *iv) {
+      AesCtr *ctr = aes_ctr_context();
+      ctr->setIV(iv, 16);
+      ctr->encrypt(data, len);
+    });
+  }
+
+  return 0;
+}
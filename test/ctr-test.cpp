@@ -0,0 +1,162 @@
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "./test-utils.cpp"
+#include "aes-ctr.cpp"
+
+static const size_t MAX_LEN = 300;
+
+static void random_bytes(uint8_t *data, const size_t &len) {
+  for (size_t i = 0; i < len; i++) {
+    data[i] = (uint8_t)rand();
+  }
+}
+
+/**
+ * CTR one block at a time with a byte by byte XOR, the last
+ * `counter_size` bytes of the IV are the big endian counter
+ */
+static void reference_ctr(
+  const uint8_t *key, const uint8_t *iv, const uint8_t &counter_size,
+  uint8_t *output, const uint8_t *input, const size_t &len
+) {
+  AES256 cipher;
+  cipher.setKey(key, 32);
+
+  uint8_t counter[16];
+  memcpy(counter, iv, 16);
+
+  for (size_t offset = 0; offset < len; offset += 16) {
+    uint8_t keystream[16];
+    cipher.encryptBlock(keystream, counter);
+
+    for (size_t i = 0; i < 16 && offset + i < len; i++) {
+      output[offset + i] = input[offset + i] ^ keystream[i];
+    }
+
+    for (uint8_t i = 16; i > 16 - counter_size; i--) {
+      if (++counter[i - 1] != 0) {
+        break;
+      }
+    }
+  }
+}
+
+// SP 800-38A F.5.5, CTR-AES256.Encrypt
+template <typename Cipher>
+static void test_vector() {
+  const std::vector<uint8_t> key = test_hex("603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4");
+  const std::vector<uint8_t> iv = test_hex("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff");
+  const std::vector<uint8_t> plaintext = test_hex(
+    "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+    "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710"
+  );
+  const std::vector<uint8_t> ciphertext = test_hex(
+    "601ec313775789a5b7a7f504bbf3d228f443e3ca4d62b59aca84e990cacaf5c5"
+    "2b0930daa23de94ce87017ba2d84988ddfc9c58db67aada613c2dd08457941a6"
+  );
+
+  CTR<Cipher> ctr;
+  TEST_CHECK(ctr.setKey(key.data(), key.size()));
+  TEST_CHECK(ctr.setIV(iv.data(), iv.size()));
+
+  std::vector<uint8_t> output(plaintext.size());
+  ctr.encrypt(output.data(), plaintext.data(), plaintext.size());
+  TEST_CHECK(output == ciphertext);
+
+  TEST_CHECK(ctr.setIV(iv.data(), iv.size()));
+  ctr.decrypt(output.data(), output.size());
+  TEST_CHECK(output == plaintext);
+}
+
+/**
+ * Random lengths split in random chunks, with every alignment of the
+ * input and the output, against the block by block reference
+ */
+template <typename Cipher>
+static void test_reference() {
+  srand(1);
+
+  static uint8_t input[MAX_LEN + 4];
+  static uint8_t output[MAX_LEN + 4];
+  static uint8_t expected[MAX_LEN];
+
+  for (int round = 0; round < 2000; round++) {
+    uint8_t key[32];
+    uint8_t iv[16];
+    const size_t len = rand() % (MAX_LEN + 1);
+    const uint8_t input_offset = rand() % 4;
+    const uint8_t output_offset = rand() % 4;
+
+    random_bytes(key, sizeof(key));
+    random_bytes(iv, sizeof(iv));
+    random_bytes(input + input_offset, len);
+
+    // Some counters wrap around in the first blocks
+    if (round % 4 == 0) {
+      memset(iv + 12, 0xFF, 4);
+    }
+
+    reference_ctr(key, iv, 4, expected, input + input_offset, len);
+
+    CTR<Cipher> ctr;
+    ctr.setKey(key, sizeof(key));
+    ctr.setCounterSize(4);
+    ctr.setIV(iv, sizeof(iv));
+
+    size_t offset = 0;
+    while (offset < len) {
+      size_t chunk = rand() % 3 == 0 ? rand() % 80 : len - offset;
+      if (chunk > len - offset) {
+        chunk = len - offset;
+      }
+
+      ctr.encrypt(output + output_offset + offset, input + input_offset + offset, chunk);
+      offset += chunk;
+    }
+
+    TEST_CHECK(memcmp(output + output_offset, expected, len) == 0);
+
+    // The in place overload from an unaligned buffer
+    ctr.setIV(iv, sizeof(iv));
+    ctr.encrypt(input + input_offset, len);
+    TEST_CHECK(memcmp(input + input_offset, expected, len) == 0);
+  }
+}
+
+/**
+ * The context used by the firmware decrypts what it encrypted
+ */
+static void test_context() {
+  uint8_t iv[16];
+  uint8_t data[100];
+  uint8_t original[100];
+
+  random_fill(iv, sizeof(iv));
+  random_bytes(original, sizeof(original));
+  memcpy(data, original, sizeof(data));
+
+  AesCtr *ctr = aes_ctr_context();
+  ctr->setIV(iv, sizeof(iv));
+  ctr->encrypt(data, sizeof(data));
+  TEST_CHECK(memcmp(data, original, sizeof(data)) != 0);
+
+  ctr->setIV(iv, sizeof(iv));
+  ctr->decrypt(data, sizeof(data));
+  TEST_CHECK(memcmp(data, original, sizeof(data)) == 0);
+}
+
+int main() {
+  printf("[Test] CTR_KEYSTREAM_BLOCKS %d\n", CTR_KEYSTREAM_BLOCKS);
+
+  TEST_RUN(test_vector<AES256>);
+  TEST_RUN(test_vector<AesFast256>);
+  TEST_RUN(test_vector<AesSliced256>);
+  TEST_RUN(test_reference<AES256>);
+  TEST_RUN(test_reference<AesFast256>);
+  TEST_RUN(test_reference<AesSliced256>);
+  TEST_RUN(test_context);
+
+  return test_result();
+}
@@ -0,0 +1,103 @@
+#include <string.h>
+#include <sstream>
+#include <string>
+
+#include "./test-utils.cpp"
+#include "frame.cpp"
+
+static const size_t FRAMES = 200000;
+static const size_t SEGMENT_SIZE = 1460;
+
+/**
+ * The parser the decoder replaced, it's called with the received bytes
+ * of the current frame and copies them to find the length prefix.
+ */
+static bool string_parse(const uint8_t *buffer, const size_t &recv_len, std::string *packet) {
+  std::string partial_packet((const char*)buffer, recv_len);
+  std::string packet_length_s;
+
+  std::istringstream iss_input(partial_packet);
+  std::getline(iss_input, packet_length_s, ';');
+
+  if (packet_length_s == partial_packet) {
+    return false;
+  }
+
+  const int packet_length = std::stoi(packet_length_s);
+  const size_t data_len = packet_length_s.size() + 1;
+  if (recv_len < packet_length + data_len) {
+    return false;
+  }
+
+  *packet = std::string((const char*)buffer, data_len, packet_length);
+  return true;
+}
+
+int main() {
+  // A PING sized request repeated in MSS sized segments
+  const std::string payload = "{\"type\":\"PING\",\"id\":\"0123456789abcdef\",\"data\":{}}";
+  const std::string frame = std::to_string(payload.size()) + ";" + payload;
+
+  std::string stream;
+  while (stream.size() < SEGMENT_SIZE * 64) {
+    stream += frame;
+  }
+
+  const size_t frames_in_stream = stream.size() / frame.size();
+  const size_t rounds = FRAMES / frames_in_stream;
+  const size_t frames = rounds * frames_in_stream;
+
+  uint8_t buffer[TCP_SERVER_BUF_SIZE];
+
+  size_t allocations = test_allocations;
+  const double string_ns = bench_ns(rounds, [&] (const size_t &i) {
+    size_t recv_len = 0;
+    std::string packet;
+
+    for (size_t offset = 0; offset < stream.size(); offset += SEGMENT_SIZE) {
+      size_t segment = stream.size() - offset < SEGMENT_SIZE ? stream.size() - offset : SEGMENT_SIZE;
+      const uint8_t *data = (const uint8_t*)stream.data() + offset;
+
+      while (segment > 0) {
+        const size_t chunk = segment < frame.size() - recv_len ? segment : frame.size() - recv_len;
+        memcpy(buffer + recv_len, data, chunk);
+        recv_len += chunk;
+        data += chunk;
+        segment -= chunk;
+
+        if (string_parse(buffer, recv_len, &packet)) {
+          bench_sink += packet.size();
+          recv_len = 0;
+        }
+      }
+    }
+  }) / frames_in_stream;
+  const double string_allocations = (double)(test_allocations - allocations) / frames;
+
+  allocations = test_allocations;
+  const double decoder_ns = bench_ns(rounds, [&] (const size_t &i) {
+    FRAME_DECODER_T decoder;
+
+    for (size_t offset = 0; offset < stream.size(); offset += SEGMENT_SIZE) {
+      const size_t segment = stream.size() - offset < SEGMENT_SIZE ? stream.size() - offset : SEGMENT_SIZE;
+      const uint8_t *data = (const uint8_t*)stream.data() + offset;
+      size_t consumed = 0;
+
+      while (consumed < segment) {
+        consumed += frame_decoder_feed(&decoder, buffer, sizeof(buffer), NULL, data + consumed, segment - consumed);
+
+        if (decoder.state == FRAME_STATE::COMPLETE) {
+          bench_sink += decoder.packet_len;
+          frame_decoder_reset(&decoder);
+        }
+      }
+    }
+  }) / frames_in_stream;
+  const double decoder_allocations = (double)(test_allocations - allocations) / frames;
+
+  printf("[Bench] %zu frames of %zu bytes in %zu byte segments\n", frames, frame.size(), SEGMENT_SIZE);
+  printf("[Bench] string parser:  %8.1f ns/frame, %5.2f allocations/frame\n", string_ns, string_allocations);
+  printf("[Bench] frame decoder:  %8.1f ns/frame, %5.2f allocations/frame\n", decoder_ns, decoder_allocations);
+
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./test-utils.cpp"
+#include "frame-builder.cpp"
+
+static const size_t RESPONSES = 20000;
+
+/* #region String frames */
+
+// The response path the frame builder replaced, dump, encrypt, base64 and concatenate
+
+static std::unique_ptr<u_int8_t[]> string_random_bytes(u_int8_t size) {
+  static std::default_random_engine randomEngine(0);
+  static std::uniform_int_distribution<u_int8_t> uniformDist(CHAR_MIN, CHAR_MAX);
+
+  std::vector<u_int8_t> data(size);
+  std::generate(data.begin(), data.end(), [] () {
+    return uniformDist(randomEngine);
+  });
+
+  std::unique_ptr<u_int8_t[]> buffer = std::make_unique<u_int8_t[]>(size);
+  for (u_int8_t i = 0; i < size; i++) {
+    buffer[i] = u_int8_t(data[i]);
+  }
+
+  return buffer;
+}
+
+static std::string string_encrypt(const std::string &value) {
+  u_int8_t plaintext[value.length() + 1];
+  memcpy(plaintext, value.c_str(), value.length());
+
+  u_int8_t key[32];
+  memcpy(key, base64_decode(std::string(AES_ENCRYPTION_KEY)).c_str(), 32);
+
+  const u_int8_t *iv = string_random_bytes(16).release();
+
+  CTR<AES256> ctr;
+  ctr.clear();
+  ctr.setKey(key, 32);
+  ctr.setIV(iv, 16);
+  ctr.setCounterSize(4);
+
+  u_int8_t output[value.length() + 1];
+  ctr.encrypt(output, plaintext, value.length());
+
+  const std::string encrypted = base64_encode(std::string(iv, iv + 16) + std::string(output, output + value.length()));
+  delete [] iv;
+
+  return encrypted;
+}
+
+static std::string string_frame(const json &packet) {
+  const std::string data = string_encrypt(packet.dump());
+  return std::to_string(data.size()) + std::string(";") + data;
+}
+
+/* #endregion */
+
+static void bench(const char *name, const json &packet) {
+  uint8_t buffer[TCP_SERVER_BUF_SIZE];
+  std::vector<uint8_t> client_buffer(TCP_SERVER_BUF_SIZE);
+
+  size_t allocations = test_allocations;
+  const double string_ns = bench_ns(RESPONSES, [&] (const size_t &i) {
+    const std::string frame = string_frame(packet);
+    // Copied to the client's send buffer
+    memcpy(client_buffer.data(), frame.data(), frame.size());
+    bench_sink += frame.size();
+  });
+  const double string_allocations = (double)(test_allocations - allocations) / RESPONSES;
+
+  allocations = test_allocations;
+  const double builder_ns = bench_ns(RESPONSES, [&] (const size_t &i) {
+    uint16_t offset = 0;
+    uint16_t len = 0;
+    frame_build(packet, buffer, sizeof(buffer), &offset, &len);
+    bench_sink += len;
+  });
+  const double builder_allocations = (double)(test_allocations - allocations) / RESPONSES;
+
+  // A pool buffer is free only when the frame doesn't fit, so it's sized first
+  allocations = test_allocations;
+  const double heap_ns = bench_ns(RESPONSES, [&] (const size_t &i) {
+    uint16_t offset = 0;
+    uint16_t len = 0;
+    const size_t capacity = frame_capacity(packet);
+    std::shared_ptr<std::string> data = std::make_shared<std::string>(capacity, '\0');
+    frame_build(packet, (uint8_t*)data->data(), capacity, &offset, &len);
+    bench_sink += len;
+  });
+  const double heap_allocations = (double)(test_allocations - allocations) / RESPONSES;
+
+  printf("[Bench] %s response (%zu bytes of JSON)\n", name, packet.dump().size());
+  printf("[Bench]   strings:            %8.1f ns, %5.2f allocations\n", string_ns, string_allocations);
+  printf("[Bench]   frame_build:        %8.1f ns, %5.2f allocations\n", builder_ns, builder_allocations);
+  printf("[Bench]   frame_build (heap): %8.1f ns, %5.2f allocations\n", heap_ns, heap_allocations);
+}
+
+int main() {
+  bench("PING", { {"type", "PING"}, {"id", "0123456789abcdef"}, {"client_id", "192.168.1.20:50000"} });
+
+  json data;
+  for (int i = 0; i < 24; i++) {
+    data["field_" + std::to_string(i)] = i * 1.5;
+  }
+
+  bench("GET", { {"type", "GET"}, {"id", "0123456789abcdef"}, {"client_id", "192.168.1.20:50000"}, {"data", data} });
+
+  return 0;
+}
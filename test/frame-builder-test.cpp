@@ -0,0 +1,91 @@
+#include <string.h>
+#include <string>
+
+#include "./test-utils.cpp"
+#include "frame-builder.cpp"
+
+/**
+ * Decodes a built frame back to the JSON text
+ */
+static std::string unframe(const uint8_t *buffer, const uint16_t &offset, const uint16_t &len) {
+  const std::string frame((const char*)buffer + offset, len);
+  const size_t separator = frame.find(';');
+  if (separator == std::string::npos || std::stoul(frame.substr(0, separator)) != len - separator - 1) {
+    return "";
+  }
+
+  return decrypt_256_aes_ctr(std::string_view(frame).substr(separator + 1));
+}
+
+static json packet_of_size(const size_t &size) {
+  return { {"type", "GET"}, {"data", std::string(size, 'x')} };
+}
+
+static void test_round_trip() {
+  const json packet = { {"type", "PING"}, {"id", "1"}, {"client_id", "server"} };
+  uint8_t buffer[TCP_SERVER_BUF_SIZE];
+  uint16_t offset = 0;
+  uint16_t len = 0;
+
+  TEST_CHECK(frame_build(packet, buffer, sizeof(buffer), &offset, &len));
+  TEST_CHECK(unframe(buffer, offset, len) == packet.dump());
+
+  // A fresh IV for every frame
+  uint8_t other[TCP_SERVER_BUF_SIZE];
+  uint16_t other_offset = 0;
+  uint16_t other_len = 0;
+
+  TEST_CHECK(frame_build(packet, other, sizeof(other), &other_offset, &other_len));
+  TEST_CHECK(len == other_len && memcmp(buffer + offset, other + other_offset, len) != 0);
+}
+
+static void test_too_large() {
+  uint8_t buffer[64];
+  uint16_t offset = 0;
+  uint16_t len = 0;
+
+  TEST_CHECK(!frame_build(packet_of_size(64), buffer, sizeof(buffer), &offset, &len));
+}
+
+static void test_capacity() {
+  std::string data;
+  uint16_t offset = 0;
+  uint16_t len = 0;
+
+  // Every size around the points where the prefix gets one more digit
+  for (size_t size = 0; size < 1200; size++) {
+    const json packet = packet_of_size(size);
+    const size_t capacity = frame_capacity(packet);
+
+    data.assign(capacity, '\0');
+    const bool built = frame_build(packet, (uint8_t*)data.data(), capacity, &offset, &len);
+    TEST_CHECK(built);
+    TEST_CHECK(!built || unframe((const uint8_t*)data.data(), offset, len) == packet.dump());
+
+    // The capacity is exact, the frame fills it except for the unused prefix digits
+    TEST_CHECK(!frame_build(packet, (uint8_t*)data.data(), capacity - 1, &offset, &len));
+  }
+}
+
+static void test_no_allocations() {
+  const json packet = { {"type", "PING"}, {"id", "1"}, {"client_id", "server"} };
+  uint8_t buffer[TCP_SERVER_BUF_SIZE];
+  uint16_t offset = 0;
+  uint16_t len = 0;
+
+  frame_build(packet, buffer, sizeof(buffer), &offset, &len);
+
+  const size_t allocations = test_allocations;
+  frame_build(packet, buffer, sizeof(buffer), &offset, &len);
+  frame_capacity(packet);
+  TEST_CHECK(test_allocations == allocations);
+}
+
+int main() {
+  TEST_RUN(test_round_trip);
+  TEST_RUN(test_too_large);
+  TEST_RUN(test_capacity);
+  TEST_RUN(test_no_allocations);
+
+  return test_result();
+}
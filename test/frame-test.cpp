@@ -0,0 +1,305 @@
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "./test-utils.cpp"
+#include "frame.cpp"
+
+static const size_t BUFFER_SIZE = 16;
+
+typedef struct DECODED_T_ {
+  FRAME_DECODER_T decoder;
+  uint8_t buffer[BUFFER_SIZE];
+} DECODED_T;
+
+/**
+ * Stream that keeps the payload, it can be told to refuse the frame or a write
+ */
+class TestStream : public FrameStream {
+  public:
+    const void *owner = nullptr;
+    std::string data;
+    bool refuse_begin = false;
+    bool refuse_write = false;
+    uint32_t begin_len = 0;
+
+    uint32_t max_size() override {
+      return 64;
+    }
+
+    bool begin(const void *owner, const uint32_t &len) override {
+      if (this->refuse_begin) {
+        return false;
+      }
+
+      this->owner = owner;
+      this->begin_len = len;
+      this->data.clear();
+      return true;
+    }
+
+    bool write(const uint8_t *data, const size_t &len) override {
+      if (this->refuse_write) {
+        return false;
+      }
+
+      this->data.append((const char*)data, len);
+      return true;
+    }
+
+    void release(const void *owner) override {
+      if (this->owner == owner) {
+        this->owner = nullptr;
+      }
+    }
+};
+
+static size_t feed(DECODED_T *decoded, const std::string &data, FrameStream *stream = nullptr) {
+  return frame_decoder_feed(&decoded->decoder, decoded->buffer, BUFFER_SIZE, stream, (const uint8_t*)data.data(), data.size());
+}
+
+static std::string payload(const DECODED_T *decoded) {
+  return std::string((const char*)decoded->buffer, decoded->decoder.packet_len);
+}
+
+static void test_single_frame() {
+  DECODED_T decoded;
+  TEST_CHECK(frame_decoder_idle(&decoded.decoder));
+
+  TEST_CHECK(feed(&decoded, "5;hello") == 7);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::COMPLETE);
+  TEST_CHECK(decoded.decoder.stream == nullptr);
+  TEST_CHECK(payload(&decoded) == "hello");
+
+  frame_decoder_reset(&decoded.decoder);
+  TEST_CHECK(frame_decoder_idle(&decoded.decoder));
+}
+
+static void test_split_length_prefix() {
+  DECODED_T decoded;
+
+  TEST_CHECK(feed(&decoded, "1") == 1);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::LENGTH);
+  TEST_CHECK(!frame_decoder_idle(&decoded.decoder));
+
+  TEST_CHECK(feed(&decoded, "2") == 1);
+  TEST_CHECK(feed(&decoded, ";abc") == 4);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::PAYLOAD);
+
+  TEST_CHECK(feed(&decoded, "defghijkl") == 9);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::COMPLETE);
+  TEST_CHECK(payload(&decoded) == "abcdefghijkl");
+}
+
+static void test_byte_by_byte() {
+  const std::string frame = "11;hello world";
+  DECODED_T decoded;
+
+  for (size_t i = 0; i < frame.size(); i++) {
+    TEST_CHECK(decoded.decoder.state != FRAME_STATE::COMPLETE);
+    TEST_CHECK(feed(&decoded, frame.substr(i, 1)) == 1);
+  }
+
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::COMPLETE);
+  TEST_CHECK(payload(&decoded) == "hello world");
+}
+
+static void test_pipelined_frames() {
+  const std::string data = "3;abc4;defg1;h";
+  std::vector<std::string> frames;
+  DECODED_T decoded;
+  size_t offset = 0;
+
+  while (offset < data.size()) {
+    offset += feed(&decoded, data.substr(offset));
+
+    if (decoded.decoder.state == FRAME_STATE::COMPLETE) {
+      frames.push_back(payload(&decoded));
+      frame_decoder_reset(&decoded.decoder);
+    }
+  }
+
+  TEST_CHECK(frames.size() == 3);
+  TEST_CHECK(frames.size() == 3 && frames[0] == "abc" && frames[1] == "defg" && frames[2] == "h");
+}
+
+static void test_malformed() {
+  const char *frames[] = { "x;", ";abc", "0;", "12a;", "-1;", "00;" };
+
+  for (const char *frame : frames) {
+    DECODED_T decoded;
+    feed(&decoded, frame);
+    TEST_CHECK(decoded.decoder.state == FRAME_STATE::MALFORMED);
+  }
+
+  // A malformed decoder consumes nothing until it's reset
+  DECODED_T decoded;
+  TEST_CHECK(feed(&decoded, "x;") == 1);
+  TEST_CHECK(feed(&decoded, "1;a") == 0);
+
+  frame_decoder_reset(&decoded.decoder);
+  TEST_CHECK(feed(&decoded, "1;a") == 3);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::COMPLETE);
+}
+
+static void test_oversize() {
+  DECODED_T decoded;
+
+  // Rejected as soon as the length is larger than the buffer
+  TEST_CHECK(feed(&decoded, "17;") == 2);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::MALFORMED);
+
+  // A long run of digits doesn't overflow the length
+  frame_decoder_reset(&decoded.decoder);
+  TEST_CHECK(feed(&decoded, "99999999999999999999;") == 2);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::MALFORMED);
+
+  // The largest frame that fits
+  frame_decoder_reset(&decoded.decoder);
+  feed(&decoded, "16;" + std::string(16, 'a'));
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::COMPLETE);
+}
+
+static void test_stream() {
+  const std::string data(40, 's');
+  TestStream stream;
+  DECODED_T decoded;
+
+  TEST_CHECK(feed(&decoded, "40;" + data.substr(0, 10), &stream) == 13);
+  TEST_CHECK(decoded.decoder.stream == &stream);
+  TEST_CHECK(stream.begin_len == 40);
+
+  TEST_CHECK(feed(&decoded, data.substr(10) + "2;ok", &stream) == 30);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::COMPLETE);
+  TEST_CHECK(stream.data == data);
+
+  frame_decoder_reset(&decoded.decoder);
+  TEST_CHECK(stream.owner == nullptr);
+  TEST_CHECK(decoded.decoder.stream == nullptr);
+
+  // Frames that fit in the buffer don't use the stream
+  TEST_CHECK(feed(&decoded, "2;ok", &stream) == 4);
+  TEST_CHECK(decoded.decoder.stream == nullptr);
+  TEST_CHECK(payload(&decoded) == "ok");
+
+  // Larger than the stream
+  frame_decoder_reset(&decoded.decoder);
+  feed(&decoded, "65;", &stream);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::MALFORMED);
+
+  // The stream is busy
+  frame_decoder_reset(&decoded.decoder);
+  stream.refuse_begin = true;
+  feed(&decoded, "20;", &stream);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::MALFORMED);
+  TEST_CHECK(decoded.decoder.stream == nullptr);
+
+  // The stream fails to handle the data
+  frame_decoder_reset(&decoded.decoder);
+  stream.refuse_begin = false;
+  stream.refuse_write = true;
+  feed(&decoded, "20;" + data.substr(0, 20), &stream);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::MALFORMED);
+
+  frame_decoder_reset(&decoded.decoder);
+  TEST_CHECK(stream.owner == nullptr);
+}
+
+/**
+ * Splits `data` in a chain of pbufs with the given lengths
+ */
+static struct pbuf* make_chain(std::vector<struct pbuf> &chain, const std::string &data, const std::vector<u16_t> &lengths) {
+  chain.resize(lengths.size());
+
+  size_t offset = 0;
+  for (size_t i = 0; i < lengths.size(); i++) {
+    chain[i].next = i + 1 < lengths.size() ? &chain[i + 1] : NULL;
+    chain[i].payload = (void*)(data.data() + offset);
+    chain[i].len = lengths[i];
+    chain[i].tot_len = data.size() - offset;
+    offset += lengths[i];
+  }
+
+  return &chain[0];
+}
+
+static void test_pbuf_chain() {
+  const std::string data = "10;abcdefghij2;xy";
+  std::vector<struct pbuf> chain;
+  struct pbuf *p = make_chain(chain, data, { 1, 6, 8, 2 });
+  DECODED_T decoded;
+
+  // The first frame spans three pbufs and ends in the middle of the third one
+  const uint16_t consumed = frame_decoder_feed_pbuf(&decoded.decoder, decoded.buffer, BUFFER_SIZE, NULL, p, 0);
+  TEST_CHECK(consumed == 13);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::COMPLETE);
+  TEST_CHECK(payload(&decoded) == "abcdefghij");
+
+  // The next one starts at an offset into the chain
+  frame_decoder_reset(&decoded.decoder);
+  TEST_CHECK(frame_decoder_feed_pbuf(&decoded.decoder, decoded.buffer, BUFFER_SIZE, NULL, p, consumed) == 4);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::COMPLETE);
+  TEST_CHECK(payload(&decoded) == "xy");
+}
+
+static void test_pbuf_partial() {
+  const std::string data = "8;abcd";
+  std::vector<struct pbuf> chain;
+  struct pbuf *p = make_chain(chain, data, { 3, 3 });
+  DECODED_T decoded;
+
+  TEST_CHECK(frame_decoder_feed_pbuf(&decoded.decoder, decoded.buffer, BUFFER_SIZE, NULL, p, 0) == 6);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::PAYLOAD);
+
+  const std::string rest = "efgh";
+  p = make_chain(chain, rest, { 4 });
+  TEST_CHECK(frame_decoder_feed_pbuf(&decoded.decoder, decoded.buffer, BUFFER_SIZE, NULL, p, 0) == 4);
+  TEST_CHECK(payload(&decoded) == "abcdefgh");
+}
+
+static void test_pbuf_malformed() {
+  const std::string data = "4;abcdx;4;efgh";
+  std::vector<struct pbuf> chain;
+  struct pbuf *p = make_chain(chain, data, { 2, 5, 7 });
+  DECODED_T decoded;
+
+  uint16_t consumed = frame_decoder_feed_pbuf(&decoded.decoder, decoded.buffer, BUFFER_SIZE, NULL, p, 0);
+  TEST_CHECK(consumed == 6);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::COMPLETE);
+
+  // The walk stops at the bad byte, the rest of the chain is left
+  frame_decoder_reset(&decoded.decoder);
+  consumed += frame_decoder_feed_pbuf(&decoded.decoder, decoded.buffer, BUFFER_SIZE, NULL, p, consumed);
+  TEST_CHECK(consumed == 7);
+  TEST_CHECK(decoded.decoder.state == FRAME_STATE::MALFORMED);
+}
+
+static void test_no_allocations() {
+  const std::string data = "3;abc4;defg";
+  DECODED_T decoded;
+  const size_t allocations = test_allocations;
+
+  size_t offset = 0;
+  while (offset < data.size()) {
+    offset += frame_decoder_feed(&decoded.decoder, decoded.buffer, BUFFER_SIZE, NULL, (const uint8_t*)data.data() + offset, data.size() - offset);
+    frame_decoder_reset(&decoded.decoder);
+  }
+
+  TEST_CHECK(test_allocations == allocations);
+}
+
+int main() {
+  TEST_RUN(test_single_frame);
+  TEST_RUN(test_split_length_prefix);
+  TEST_RUN(test_byte_by_byte);
+  TEST_RUN(test_pipelined_frames);
+  TEST_RUN(test_malformed);
+  TEST_RUN(test_oversize);
+  TEST_RUN(test_stream);
+  TEST_RUN(test_pbuf_chain);
+  TEST_RUN(test_pbuf_partial);
+  TEST_RUN(test_pbuf_malformed);
+  TEST_RUN(test_no_allocations);
+
+  return test_result();
+}
@@ -0,0 +1,111 @@
+#include <string.h>
+#include <string>
+
+#include "./test-utils.cpp"
+#include "idempotency-cache.cpp"
+
+static ip_addr_t test_addr(const uint8_t &last) {
+  ip_addr_t addr;
+  addr.addr = 0x0000A8C0 + (last << 24);
+  return addr;
+}
+
+static void test_key() {
+  const ip_addr_t addr = test_addr(20);
+  const ip_addr_t other_addr = test_addr(21);
+  const uint8_t frame[] = "reply";
+
+  IDEMPOTENCY_ENTRY_T *entry = idempotency_cache_insert(&addr, 50000, "key", 1);
+  TEST_CHECK(entry != NULL && entry->state == IDEMPOTENCY_STATE::PENDING);
+
+  // Another port or address with the same id doesn't match, while pending or done
+  TEST_CHECK(idempotency_cache_find(&addr, 50000, "key") == entry);
+  TEST_CHECK(idempotency_cache_find(&addr, 50001, "key") == NULL);
+  TEST_CHECK(idempotency_cache_find(&other_addr, 50000, "key") == NULL);
+
+  idempotency_cache_complete(1, frame, sizeof(frame));
+  TEST_CHECK(entry->state == IDEMPOTENCY_STATE::DONE && entry->len == sizeof(frame));
+  TEST_CHECK(idempotency_cache_find(&addr, 50000, "key") == entry);
+  TEST_CHECK(idempotency_cache_find(&addr, 50001, "key") == NULL);
+  TEST_CHECK(idempotency_cache_find(&other_addr, 50000, "key") == NULL);
+
+  // The same id from another port is a separate entry
+  IDEMPOTENCY_ENTRY_T *other = idempotency_cache_insert(&addr, 50001, "key", 2);
+  TEST_CHECK(other != NULL && other != entry);
+  TEST_CHECK(idempotency_cache_find(&addr, 50000, "key") == entry);
+  TEST_CHECK(idempotency_cache_find(&addr, 50001, "key") == other);
+
+  idempotency_cache_complete(2, NULL, 0);
+  TEST_CHECK(idempotency_cache_find(&addr, 50001, "key") == NULL);
+
+  TEST_CHECK(idempotency_cache_insert(&addr, 50000, "", 3) == NULL);
+  TEST_CHECK(idempotency_cache_insert(&addr, 50000, std::string(IDEMPOTENCY_CACHE_ID_SIZE, 'a'), 3) == NULL);
+}
+
+/**
+ * The replies expire after IDEMPOTENCY_CACHE_TTL_MS, a pending command never does
+ */
+static void test_ttl() {
+  const ip_addr_t addr = test_addr(30);
+  const uint8_t frame[] = "reply";
+
+  idempotency_cache_insert(&addr, 50000, "done", 10);
+  idempotency_cache_complete(10, frame, sizeof(frame));
+  idempotency_cache_insert(&addr, 50000, "pending", 11);
+
+  stub_time_advance_us += (IDEMPOTENCY_CACHE_TTL_MS - 100) * 1000ULL;
+  TEST_CHECK(idempotency_cache_find(&addr, 50000, "done") != NULL);
+
+  stub_time_advance_us += 100 * 1000ULL;
+  TEST_CHECK(idempotency_cache_find(&addr, 50000, "done") == NULL);
+  TEST_CHECK(idempotency_cache_find(&addr, 50000, "pending") != NULL);
+
+  // The reply is kept for the full time after the command completes
+  idempotency_cache_complete(11, frame, sizeof(frame));
+  stub_time_advance_us += (IDEMPOTENCY_CACHE_TTL_MS - 100) * 1000ULL;
+  TEST_CHECK(idempotency_cache_find(&addr, 50000, "pending") != NULL);
+
+  stub_time_advance_us += 100 * 1000ULL;
+  TEST_CHECK(idempotency_cache_find(&addr, 50000, "pending") == NULL);
+
+  for (const IDEMPOTENCY_ENTRY_T &entry : idempotency_cache.entries) {
+    TEST_CHECK(entry.state != IDEMPOTENCY_STATE::DONE);
+  }
+}
+
+/**
+ * The least recently used reply is evicted, the pending commands are kept
+ */
+static void test_eviction() {
+  const ip_addr_t addr = test_addr(40);
+  const uint8_t frame[] = "reply";
+
+  stub_time_advance_us += IDEMPOTENCY_CACHE_TTL_MS * 1000ULL;
+
+  for (uint32_t i = 0; i < IDEMPOTENCY_CACHE_SIZE; i++) {
+    TEST_CHECK(idempotency_cache_insert(&addr, 50000, "id" + std::to_string(i), 100 + i) != NULL);
+  }
+
+  TEST_CHECK(idempotency_cache_insert(&addr, 50000, "full", 200) == NULL);
+
+  idempotency_cache_complete(100, frame, sizeof(frame));
+  idempotency_cache_complete(101, frame, sizeof(frame));
+  TEST_CHECK(idempotency_cache_find(&addr, 50000, "id0") != NULL);
+
+  // id1 is the least recently used reply
+  TEST_CHECK(idempotency_cache_insert(&addr, 50000, "new", 201) != NULL);
+  TEST_CHECK(idempotency_cache_find(&addr, 50000, "id1") == NULL);
+  TEST_CHECK(idempotency_cache_find(&addr, 50000, "id0") != NULL);
+
+  for (uint32_t i = 2; i < IDEMPOTENCY_CACHE_SIZE; i++) {
+    TEST_CHECK(idempotency_cache_find(&addr, 50000, "id" + std::to_string(i)) != NULL);
+  }
+}
+
+int main() {
+  TEST_RUN(test_key);
+  TEST_RUN(test_ttl);
+  TEST_RUN(test_eviction);
+
+  return test_result();
+}
@@ -0,0 +1,240 @@
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "./test-utils.cpp"
+#include "stream.cpp"
+
+/**
+ * Builds the parsed value, json_sax_dom_parser doesn't implement the json_sax interface
+ */
+class DomSax : public nlohmann::json_sax<json> {
+  private:
+    nlohmann::detail::json_sax_dom_parser<json> parser;
+
+  public:
+    DomSax(json &result) : parser(result, false) {}
+
+    bool null() override { return this->parser.null(); }
+    bool boolean(bool val) override { return this->parser.boolean(val); }
+    bool number_integer(number_integer_t val) override { return this->parser.number_integer(val); }
+    bool number_unsigned(number_unsigned_t val) override { return this->parser.number_unsigned(val); }
+    bool number_float(number_float_t val, const string_t& s) override { return this->parser.number_float(val, s); }
+    bool string(string_t& val) override { return this->parser.string(val); }
+    bool binary(binary_t& val) override { return false; }
+    bool start_object(std::size_t elements) override { return this->parser.start_object(elements); }
+    bool key(string_t& val) override { return this->parser.key(val); }
+    bool end_object() override { return this->parser.end_object(); }
+    bool start_array(std::size_t elements) override { return this->parser.start_array(elements); }
+    bool end_array() override { return this->parser.end_array(); }
+
+    bool parse_error(std::size_t position, const std::string& last_token, const nlohmann::detail::exception& ex) override {
+      return false;
+    }
+};
+
+/**
+ * Parses `text` written in the given chunk sizes, the last size repeats.
+ * Returns false if the parser rejected it.
+ */
+static bool stream_parse(const std::string &text, const std::vector<size_t> &chunks, json *result) {
+  JsonStream parser;
+  *result = json();
+  DomSax sax(*result);
+  parser.reset(&sax);
+
+  size_t offset = 0;
+  size_t index = 0;
+  while (offset < text.size()) {
+    size_t chunk = chunks[index < chunks.size() - 1 ? index++ : index];
+    if (chunk > text.size() - offset) {
+      chunk = text.size() - offset;
+    }
+
+    if (!parser.write((const uint8_t*)text.data() + offset, chunk)) {
+      return false;
+    }
+
+    offset += chunk;
+  }
+
+  return parser.end();
+}
+
+static bool stream_parse(const std::string &text, json *result) {
+  return stream_parse(text, { text.size() > 0 ? text.size() : 1 }, result);
+}
+
+static bool stream_accepts(const std::string &text) {
+  json result;
+  return stream_parse(text, &result);
+}
+
+static const char *documents[] = {
+  "{\"type\":\"SET\",\"id\":\"0123456789abcdef\",\"body\":{\"height\":72.5,\"presets\":[1,2,3],\"name\":\"desk\"}}",
+  "[true,false,null,-0,0.5,-12.25e-3,1E+2,18446744073709551615,-9223372036854775808]",
+  " { \"a\" : [ { } , [ ] , \"\" ] , \"b\" : { \"c\" : \"d\" } } ",
+  "\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u0041\\u00e9\\u20ac\\ud83d\\ude00\"",
+  "12345",
+  "-7"
+};
+
+/**
+ * Every split in two chunks and one byte at a time give the same value as json::parse
+ */
+static void test_chunks() {
+  for (const char *document : documents) {
+    const std::string text = document;
+    const json expected = json::parse(text);
+    json result;
+
+    TEST_CHECK(stream_parse(text, &result) && result == expected);
+    TEST_CHECK(stream_parse(text, { 1 }, &result) && result == expected);
+
+    for (size_t split = 1; split < text.size(); split++) {
+      TEST_CHECK(stream_parse(text, { split, text.size() }, &result) && result == expected);
+    }
+  }
+}
+
+static void test_escapes() {
+  json result;
+
+  TEST_CHECK(stream_parse("\"a\\u00e9\\u20ac\\uD83D\\uDE00\"", { 1 }, &result));
+  TEST_CHECK(result == "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80");
+
+  // Surrogates must come in pairs, high then low
+  TEST_CHECK(!stream_accepts("\"\\ud83d\""));
+  TEST_CHECK(!stream_accepts("\"\\ude00\""));
+  TEST_CHECK(!stream_accepts("\"\\ud83d\\ud83d\""));
+  TEST_CHECK(!stream_accepts("\"\\ud83da\""));
+  TEST_CHECK(!stream_accepts("\"\\ud83d\\n\""));
+  TEST_CHECK(!stream_accepts("\"\\ude00\\ud83d\""));
+
+  TEST_CHECK(!stream_accepts("\"\\x\""));
+  TEST_CHECK(!stream_accepts("\"\\u12\""));
+  TEST_CHECK(!stream_accepts("\"\\u12g4\""));
+  TEST_CHECK(!stream_accepts("\"a\nb\""));
+}
+
+static void test_depth() {
+  const std::string open_arrays(JSON_STREAM_MAX_DEPTH, '[');
+  const std::string close_arrays(JSON_STREAM_MAX_DEPTH, ']');
+  TEST_CHECK(stream_accepts(open_arrays + close_arrays));
+  TEST_CHECK(!stream_accepts("[" + open_arrays + close_arrays + "]"));
+
+  std::string objects;
+  for (int i = 0; i < JSON_STREAM_MAX_DEPTH; i++) {
+    objects += "{\"a\":";
+  }
+  TEST_CHECK(stream_accepts(objects + "1" + std::string(JSON_STREAM_MAX_DEPTH, '}')));
+  TEST_CHECK(!stream_accepts(objects + "{}" + std::string(JSON_STREAM_MAX_DEPTH, '}')));
+}
+
+/**
+ * Strings and numbers are limited to JSON_STREAM_MAX_TOKEN bytes after the escapes are decoded
+ */
+static void test_token_limit() {
+  const std::string longest(JSON_STREAM_MAX_TOKEN, 'a');
+  json result;
+
+  TEST_CHECK(stream_parse("\"" + longest + "\"", { 7 }, &result) && result == longest);
+  TEST_CHECK(!stream_accepts("\"" + longest + "a\""));
+  TEST_CHECK(!stream_accepts("\"" + longest + "\\n\""));
+  TEST_CHECK(!stream_accepts("{\"" + longest + "a\":1}"));
+
+  // A multi byte character is counted by its UTF-8 length
+  TEST_CHECK(stream_accepts("\"" + longest.substr(2) + "\\u00e9\""));
+  TEST_CHECK(!stream_accepts("\"" + longest.substr(1) + "\\u00e9\""));
+  TEST_CHECK(stream_accepts("\"" + longest.substr(4) + "\\ud83d\\ude00\""));
+  TEST_CHECK(!stream_accepts("\"" + longest.substr(3) + "\\ud83d\\ude00\""));
+
+  const std::string digits(JSON_STREAM_MAX_TOKEN, '1');
+  TEST_CHECK(stream_accepts("[" + digits.substr(2) + ".5]"));
+  TEST_CHECK(!stream_accepts("[" + digits.substr(1) + ".5]"));
+}
+
+static void test_malformed() {
+  const char *malformed[] = {
+    "", " ", "{", "[", "}", "]", "[1,]", "[,1]", "{,}", "{\"a\"}", "{\"a\":}", "{\"a\" 1}", "{\"a\":1,}",
+    "{1:2}", "{'a':1}", "[1 2]", "[1}", "{\"a\":1]", "{}}", "{}x", "[] []", "\"abc", "tru", "nul", "True",
+    "[truex]", "01", "-01", "-", "1.", ".5", "1.e5", "1e", "1e+", "+1", "1-2", "1.2.3", "0x10", "NaN"
+  };
+
+  for (const char *text : malformed) {
+    json result;
+    const bool accepted = stream_parse(text, { 1 }, &result) || stream_parse(text, &result);
+    if (accepted) {
+      printf("[Test] Accepted %s\n", text);
+    }
+
+    TEST_CHECK(!accepted);
+    TEST_CHECK(!json::accept(text));
+  }
+}
+
+/**
+ * An encrypted packet goes through the packet stream in random chunks, the
+ * text is written by hand since `dump` sorts the keys and puts `body` first
+ */
+static void test_packet_stream() {
+  srand(1);
+
+  json body = { {"items", json::array()} };
+  for (int i = 0; i < 200; i++) {
+    body["items"].push_back({ {"index", i}, {"name", "item " + std::to_string(i)}, {"value", i * 0.25} });
+  }
+
+  const std::string text = "{\"type\":\"SET\",\"id\":\"0123456789abcdef\",\"body\":" + body.dump() + "}";
+
+  uint8_t iv[16];
+  random_fill(iv, sizeof(iv));
+  std::string encrypted = text;
+  AesCtr *ctr = aes_ctr_context();
+  ctr->setIV(iv, sizeof(iv));
+  ctr->encrypt((uint8_t*)encrypted.data(), encrypted.size());
+
+  const std::string payload = base64_encode(std::string((const char*)iv, sizeof(iv)) + encrypted);
+  TEST_CHECK(payload.size() > TCP_SERVER_BUF_SIZE);
+
+  for (int round = 0; round < 50; round++) {
+    TEST_CHECK(packet_stream.begin(&round, payload.size()));
+
+    size_t written = 0;
+    while (written < payload.size()) {
+      size_t chunk = 1 + rand() % 300;
+      if (chunk > payload.size() - written) {
+        chunk = payload.size() - written;
+      }
+
+      TEST_CHECK(packet_stream.write((const uint8_t*)payload.data() + written, chunk));
+      written += chunk;
+    }
+
+    TEST_CHECK(packet_stream.end());
+
+    PacketSax &result = packet_stream.packet();
+    TEST_CHECK(result.type == "SET" && result.id == "0123456789abcdef");
+    TEST_CHECK(result.body == body);
+
+    packet_stream.release(&round);
+  }
+
+  // A corrupted byte breaks the base64 or the JSON
+  std::string corrupted = payload;
+  corrupted[corrupted.size() / 2] = '!';
+  TEST_CHECK(packet_stream.begin(&corrupted, corrupted.size()));
+  TEST_CHECK(!packet_stream.write((const uint8_t*)corrupted.data(), corrupted.size()) || !packet_stream.end());
+  packet_stream.release(&corrupted);
+}
+
+int main() {
+  TEST_RUN(test_chunks);
+  TEST_RUN(test_escapes);
+  TEST_RUN(test_depth);
+  TEST_RUN(test_token_limit);
+  TEST_RUN(test_malformed);
+  TEST_RUN(test_packet_stream);
+
+  return test_result();
+}
@@ -0,0 +1,318 @@
+#include <string.h>
+#include <string>
+
+#include "./test-utils.cpp"
+#include "./test-service.cpp"
+#include "server.cpp"
+
+static const int CHURN_CYCLES = 2000;
+
+// One more pcb than slots, for the connection that is refused
+static struct tcp_pcb pcbs[TCP_SERVER_MAX_CLIENTS + 1];
+
+static TCP_SERVER_T *state = tcp_server_init();
+
+static struct tcp_pcb* connect(const uint8_t &index) {
+  struct tcp_pcb *pcb = &pcbs[index];
+  *pcb = tcp_pcb();
+  pcb->remote_ip.addr = 0x0100A8C0 + (index << 24);
+  pcb->remote_port = 50000 + index;
+
+  return tcp_server_accept(state, pcb, ERR_OK) == ERR_OK ? pcb : NULL;
+}
+
+/**
+ * The three ways a connection ends, closed by the server,
+ * closed by the client and aborted by lwIP
+ */
+static void disconnect(struct tcp_pcb *pcb, const int &how) {
+  TCP_CLIENT_T *client = static_cast<TCP_CLIENT_T*>(pcb->callback_arg);
+
+  if (how == 0) {
+    tcp_server_close_client(client);
+  } else if (how == 1) {
+    pcb->recv(pcb->callback_arg, pcb, NULL, ERR_OK);
+  } else {
+    pcb->errf(pcb->callback_arg, ERR_ABRT);
+  }
+}
+
+static void send_frame(struct tcp_pcb *pcb, const json &packet) {
+  uint8_t buffer[TCP_SERVER_BUF_SIZE];
+  uint16_t offset = 0;
+  uint16_t len = 0;
+
+  frame_build(packet, buffer, sizeof(buffer), &offset, &len);
+
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+  memcpy(p->payload, buffer + offset, len);
+  pcb->recv(pcb->callback_arg, pcb, p, ERR_OK);
+}
+
+/**
+ * The packet of the first frame the server wrote to the pcb
+ */
+static json written_packet(const struct tcp_pcb *pcb) {
+  const std::string frame((const char*)pcb->written, pcb->written_len);
+  const size_t separator = frame.find(';');
+  if (separator == std::string::npos) {
+    return json();
+  }
+
+  const size_t len = std::stoul(frame.substr(0, separator));
+  return json::parse(decrypt_256_aes_ctr(std::string_view(frame).substr(separator + 1, len)), nullptr, false);
+}
+
+static void test_slots() {
+  for (uint8_t i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+    TEST_CHECK(connect(i) != NULL);
+  }
+
+  TEST_CHECK(tcp_server_clients_count(state) == TCP_SERVER_MAX_CLIENTS);
+
+  // No slot is left, the connection is closed
+  TEST_CHECK(connect(TCP_SERVER_MAX_CLIENTS) == NULL);
+  TEST_CHECK(pcbs[TCP_SERVER_MAX_CLIENTS].closed);
+
+  for (uint8_t i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+    disconnect(&pcbs[i], i % 3);
+  }
+
+  TEST_CHECK(tcp_server_clients_count(state) == 0);
+}
+
+static void test_stale_handle() {
+  struct tcp_pcb *old_pcb = connect(0);
+  TCP_CLIENT_T *client = static_cast<TCP_CLIENT_T*>(old_pcb->callback_arg);
+  const TCP_CLIENT_HANDLE handle = tcp_client_handle(client);
+
+  TEST_CHECK(tcp_client_from_handle(state, handle) == client);
+  tcp_server_close_client(client);
+  TEST_CHECK(tcp_client_from_handle(state, handle) == NULL);
+
+  // The slot is reused with a new generation
+  static struct tcp_pcb new_pcb;
+  new_pcb = tcp_pcb();
+  TEST_CHECK(tcp_server_accept(state, &new_pcb, ERR_OK) == ERR_OK);
+  TEST_CHECK(new_pcb.callback_arg == client);
+  TEST_CHECK(tcp_client_from_handle(state, handle) == NULL);
+  TEST_CHECK(tcp_client_from_handle(state, tcp_client_handle(client)) == client);
+
+  // The old pcb was detached, lwIP has nothing to call back into the reused slot
+  TEST_CHECK(old_pcb->callback_arg == NULL && old_pcb->errf == NULL && old_pcb->recv == NULL);
+  TEST_CHECK(client->in_use && client->client_pcb == &new_pcb);
+
+  tcp_server_close_client(client);
+}
+
+static void test_ping() {
+  struct tcp_pcb *pcb = connect(0);
+  send_frame(pcb, { {"type", "PING"}, {"id", "42"} });
+
+  const json reply = written_packet(pcb);
+  TEST_CHECK(reply.is_object() && reply["type"] == "PING" && reply["id"] == "42");
+  TEST_CHECK(pcb->recved > 0);
+
+  disconnect(pcb, 0);
+}
+
+/**
+ * Accepting and closing connections doesn't allocate
+ */
+static void test_churn() {
+  connect(0);
+  disconnect(&pcbs[0], 0);
+
+  const size_t allocations = test_allocations;
+  const size_t pbufs = pbuf_count;
+
+  for (int cycle = 0; cycle < CHURN_CYCLES; cycle++) {
+    for (uint8_t i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+      connect(i);
+    }
+
+    for (uint8_t i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+      disconnect(&pcbs[i], (cycle + i) % 3);
+    }
+  }
+
+  printf("[Test] %d connections, %zu allocations\n", CHURN_CYCLES * TCP_SERVER_MAX_CLIENTS, test_allocations - allocations);
+
+  TEST_CHECK(test_allocations == allocations);
+  TEST_CHECK(pbuf_count == pbufs);
+  TEST_CHECK(tcp_server_clients_count(state) == 0);
+  TEST_CHECK(buffer_pool_free() == TCP_SERVER_BUFFER_POOL_SIZE);
+}
+
+/**
+ * Connections that send a request before they are closed leave nothing on the heap
+ */
+static void test_churn_with_requests() {
+  connect(0);
+  send_frame(&pcbs[0], { {"type", "PING"}, {"id", "1"} });
+  disconnect(&pcbs[0], 0);
+
+  const size_t live_allocations = test_live_allocations;
+  const size_t pbufs = pbuf_count;
+
+  for (int cycle = 0; cycle < CHURN_CYCLES; cycle++) {
+    for (uint8_t i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+      send_frame(connect(i), { {"type", "PING"}, {"id", std::to_string(cycle)} });
+    }
+
+    for (uint8_t i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+      disconnect(&pcbs[i], (cycle + i) % 3);
+    }
+  }
+
+  printf("[Test] %d connections with a request, %zd live allocations left\n", CHURN_CYCLES * TCP_SERVER_MAX_CLIENTS, (ssize_t)(test_live_allocations - live_allocations));
+
+  TEST_CHECK(test_live_allocations == live_allocations);
+  TEST_CHECK(pbuf_count == pbufs);
+  TEST_CHECK(buffer_pool_free() == TCP_SERVER_BUFFER_POOL_SIZE);
+}
+
+/**
+ * A SET retried on a new connection after a Wi-Fi drop, with a new port, is
+ * answered from the cache and the command is applied only once
+ */
+static void test_set_retry() {
+  const json set = { {"type", "SET"}, {"id", "6f1c2a9e-3b47-4d8a-9c0e-5a1b2c3d4e5f"}, {"body", json::object()} };
+  const int submitted = service_submitted;
+
+  struct tcp_pcb *first = connect(0);
+  send_frame(first, set);
+  TEST_CHECK(service_submitted == submitted + 1);
+
+  // The connection drops while the command is queued, the retry gets the reply once it's applied
+  disconnect(first, 2);
+  struct tcp_pcb *second = connect(1);
+  second->remote_ip = first->remote_ip;
+  send_frame(second, set);
+  TEST_CHECK(service_submitted == submitted + 1 && second->written_len == 0);
+
+  service_commands.process([] (const TEST_COMMAND_T &command) {});
+  handle_service_completions();
+
+  const json reply = written_packet(second);
+  TEST_CHECK(reply.is_object() && reply["type"] == "SET" && reply["id"] == set["id"]);
+  disconnect(second, 1);
+
+  // Retried again on a third connection once the reply is cached
+  struct tcp_pcb *third = connect(2);
+  third->remote_ip = first->remote_ip;
+  send_frame(third, set);
+  TEST_CHECK(service_submitted == submitted + 1);
+  TEST_CHECK(written_packet(third) == reply);
+
+  // A new id is a new command
+  send_frame(third, { {"type", "SET"}, {"id", "0b7e4c1d-8f2a-4e6b-a3d5-9c8b7a6f5e4d"}, {"body", json::object()} });
+  TEST_CHECK(service_submitted == submitted + 2);
+
+  service_commands.process([] (const TEST_COMMAND_T &command) {});
+  handle_service_completions();
+  disconnect(third, 0);
+}
+
+/**
+ * The packets pipelined behind a SET can't take the queue entry of its reply,
+ * even when lwIP refuses the writes and the replies pile up in the queue
+ */
+static void test_set_reply_reserved() {
+  struct tcp_pcb *pcb = connect(0);
+  TCP_CLIENT_T *client = static_cast<TCP_CLIENT_T*>(pcb->callback_arg);
+  const json set = { {"type", "SET"}, {"id", "9d2e6b1a-7c4f-4e3b-8a5d-1f0e9c8b7a6d"}, {"body", json::object()} };
+
+  pcb->write_err = ERR_MEM;
+  send_frame(pcb, set);
+
+  for (int i = 0; i < TCP_SERVER_SEND_QUEUE_SIZE * 2; i++) {
+    send_frame(pcb, { {"type", "PING"}, {"id", std::to_string(i)} });
+  }
+
+  TEST_CHECK(client->send_count == TCP_SERVER_SEND_QUEUE_SIZE - 1);
+  TEST_CHECK(client->rx_pending != NULL);
+
+  service_commands.process([] (const TEST_COMMAND_T &command) {});
+  handle_service_completions();
+
+  TEST_CHECK(client->send_dropped == 0 && client->send_reserved == 0);
+  TEST_CHECK(client->send_count == TCP_SERVER_SEND_QUEUE_SIZE);
+
+  // The reply is written once lwIP has room again
+  pcb->write_err = ERR_OK;
+  pcb->sent(pcb->callback_arg, pcb, 0);
+
+  bool replied = false;
+  std::string_view written((const char*)pcb->written, pcb->written_len);
+
+  while (!written.empty()) {
+    const size_t separator = written.find(';');
+    const size_t len = std::stoul(std::string(written.substr(0, separator)));
+    const json packet = json::parse(decrypt_256_aes_ctr(written.substr(separator + 1, len)), nullptr, false);
+
+    replied = replied || (packet.is_object() && packet["type"] == "SET" && packet["id"] == set["id"]);
+    written.remove_prefix(separator + 1 + len);
+  }
+
+  TEST_CHECK(replied);
+
+  disconnect(pcb, 0);
+}
+
+/**
+ * A client that stops in the middle of a frame gives its buffer back on the next poll
+ */
+static void test_stalled_frame() {
+  struct tcp_pcb *stalled[TCP_SERVER_BUFFER_POOL_SIZE];
+
+  for (uint8_t i = 0; i < TCP_SERVER_BUFFER_POOL_SIZE; i++) {
+    stalled[i] = connect(i);
+
+    const char partial[] = "2000;abc";
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, sizeof(partial) - 1, PBUF_RAM);
+    memcpy(p->payload, partial, sizeof(partial) - 1);
+    stalled[i]->recv(stalled[i]->callback_arg, stalled[i], p, ERR_OK);
+  }
+
+  TEST_CHECK(buffer_pool_free() == 0);
+
+  // Polled before the timeout the partial frames are kept
+  for (uint8_t i = 0; i < TCP_SERVER_BUFFER_POOL_SIZE; i++) {
+    stalled[i]->poll(stalled[i]->callback_arg, stalled[i]);
+  }
+
+  TEST_CHECK(buffer_pool_free() == 0);
+
+  stub_time_advance_us += (TCP_SERVER_REASSEMBLY_TIMEOUT_MS + 1) * 1000ULL;
+
+  for (uint8_t i = 0; i < TCP_SERVER_BUFFER_POOL_SIZE; i++) {
+    stalled[i]->poll(stalled[i]->callback_arg, stalled[i]);
+    TEST_CHECK(!stalled[i]->closed);
+  }
+
+  TEST_CHECK(buffer_pool_free() == TCP_SERVER_BUFFER_POOL_SIZE);
+
+  // Another client is served
+  struct tcp_pcb *pcb = connect(TCP_SERVER_BUFFER_POOL_SIZE);
+  send_frame(pcb, { {"type", "PING"}, {"id", "after"} });
+  TEST_CHECK(written_packet(pcb).is_object());
+
+  disconnect(pcb, 0);
+  for (uint8_t i = 0; i < TCP_SERVER_BUFFER_POOL_SIZE; i++) {
+    disconnect(stalled[i], 0);
+  }
+}
+
+int main() {
+  TEST_RUN(test_slots);
+  TEST_RUN(test_stale_handle);
+  TEST_RUN(test_ping);
+  TEST_RUN(test_set_retry);
+  TEST_RUN(test_set_reply_reserved);
+  TEST_RUN(test_stalled_frame);
+  TEST_RUN(test_churn);
+  TEST_RUN(test_churn_with_requests);
+
+  return test_result();
+}
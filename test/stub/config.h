@@ -0,0 +1,27 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+// The configuration of the host tests, see the config in the README
+
+#include "pico/cyw43_arch.h"
+
+#define COUNTRY_CODE_0                  'U'
+#define COUNTRY_CODE_1                  'S'
+
+#define WIFI_AUTH                       CYW43_AUTH_WPA2_AES_PSK
+#define WIFI_PASSWORD                   "PASSWORD"
+#define FIRMWARE_VERSION                "0.1.0"
+#define WIFI_SSID                       "SSID"
+
+#define SERVICE_TYPE                    2
+
+#define TCP_SERVER_PORT                 8098
+#define TCP_SERVER_BUF_SIZE             2048
+#define TCP_SERVER_POLL_TIME_S          5
+#define TCP_SERVER_MAX_CLIENTS          5
+#define TCP_SERVER_INACTIVE_TIME_S      35
+#define TCP_SERVER_BUFFER_POOL_SIZE     2
+
+#define AES_ENCRYPTION_KEY              "MDEyMzQ1Njc4OWFiY2RlZjAxMjM0NTY3ODlhYmNkZWY="
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __STUB_HARDWARE_FLASH_H__
+#define __STUB_HARDWARE_FLASH_H__
+
+#include <stdint.h>
+#include <string.h>
+
+static inline void flash_get_unique_id(uint8_t *id) {
+  memset(id, 0, 8);
+}
+
+#endif
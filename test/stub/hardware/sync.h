@@ -0,0 +1,18 @@
+#ifndef __STUB_HARDWARE_SYNC_H__
+#define __STUB_HARDWARE_SYNC_H__
+
+#include <stdint.h>
+
+static inline uint32_t save_and_disable_interrupts() {
+  return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) { }
+
+static inline void __dmb() { }
+
+static inline void __sev() { }
+
+static inline void __wfe() { }
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef __STUB_HARDWARE_WATCHDOG_H__
+#define __STUB_HARDWARE_WATCHDOG_H__
+
+static inline bool watchdog_caused_reboot() {
+  return false;
+}
+
+static inline bool watchdog_enable_caused_reboot() {
+  return false;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __STUB_LWIP_IP_ADDR_H__
+#define __STUB_LWIP_IP_ADDR_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "lwipopts.h"
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+
+// IPv4 only, the address is in network order like in lwIP
+
+typedef struct ip4_addr {
+  u32_t addr;
+} ip4_addr_t;
+
+typedef ip4_addr_t ip_addr_t;
+
+#define IPADDR_TYPE_ANY 46U
+#define IP_ADDR_ANY ((ip_addr_t*)NULL)
+
+#define ip_addr_cmp(a, b) ((a)->addr == (b)->addr)
+#define ip_addr_copy(dest, src) ((dest) = (src))
+
+static inline char* ip4addr_ntoa(const ip4_addr_t *addr) {
+  static char buffer[16];
+  const u32_t value = addr != NULL ? addr->addr : 0;
+  snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24);
+  return buffer;
+}
+
+static inline char* ipaddr_ntoa(const ip_addr_t *addr) {
+  return ip4addr_ntoa(addr);
+}
+
+struct netif {
+  ip4_addr_t ip_addr;
+};
+
+inline struct netif netif_default_storage;
+inline struct netif *netif_list = &netif_default_storage;
+
+#define netif_ip4_addr(netif) (&(netif)->ip_addr)
+
+#endif
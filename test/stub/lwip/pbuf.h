@@ -0,0 +1,98 @@
+#ifndef __STUB_LWIP_PBUF_H__
+#define __STUB_LWIP_PBUF_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+
+// pbufs from malloc with a single reference, a chain is freed from its head
+
+typedef enum {
+  PBUF_TRANSPORT = 74,
+  PBUF_IP = 54,
+  PBUF_RAW = 0
+} pbuf_layer;
+
+typedef enum {
+  PBUF_RAM = 0x280,
+  PBUF_ROM = 0x01,
+  PBUF_REF = 0x41,
+  PBUF_POOL = 0x182
+} pbuf_type;
+
+struct pbuf {
+  struct pbuf *next;
+  void *payload;
+  u16_t tot_len;
+  u16_t len;
+};
+
+inline size_t pbuf_count = 0;
+
+static inline struct pbuf* pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type) {
+  struct pbuf *p = (struct pbuf*)malloc(sizeof(struct pbuf) + (type == PBUF_REF ? 0 : length));
+  if (p == NULL) {
+    return NULL;
+  }
+
+  p->next = NULL;
+  p->payload = type == PBUF_REF ? NULL : (void*)(p + 1);
+  p->tot_len = length;
+  p->len = length;
+  pbuf_count++;
+  return p;
+}
+
+static inline u8_t pbuf_free(struct pbuf *p) {
+  u8_t count = 0;
+
+  while (p != NULL) {
+    struct pbuf *next = p->next;
+    free(p);
+    pbuf_count--;
+    count++;
+    p = next;
+  }
+
+  return count;
+}
+
+static inline void pbuf_cat(struct pbuf *head, struct pbuf *tail) {
+  struct pbuf *p = head;
+
+  for (; p->next != NULL; p = p->next) {
+    p->tot_len += tail->tot_len;
+  }
+
+  p->tot_len += tail->tot_len;
+  p->next = tail;
+}
+
+/**
+ * Drops `size` bytes from the front of the chain, the pbufs that are left empty are freed
+ */
+static inline struct pbuf* pbuf_free_header(struct pbuf *q, u16_t size) {
+  struct pbuf *p = q;
+
+  while (p != NULL && size > 0) {
+    if (size >= p->len) {
+      struct pbuf *next = p->next;
+      size -= p->len;
+      p->next = NULL;
+      pbuf_free(p);
+      p = next;
+    } else {
+      p->payload = (uint8_t*)p->payload + size;
+      p->len -= size;
+      p->tot_len -= size;
+      size = 0;
+    }
+  }
+
+  return p;
+}
+
+#endif
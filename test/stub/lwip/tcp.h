@@ -0,0 +1,117 @@
+#ifndef __STUB_LWIP_TCP_H__
+#define __STUB_LWIP_TCP_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lwipopts.h"
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+
+// A pcb that records the callbacks and the written data, a test plays the remote side.
+// The written data is kept until the test resets the pcb, which also frees the send buffer.
+
+struct tcp_pcb;
+
+typedef err_t (*tcp_accept_fn)(void *arg, struct tcp_pcb *newpcb, err_t err);
+typedef err_t (*tcp_recv_fn)(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
+typedef err_t (*tcp_sent_fn)(void *arg, struct tcp_pcb *tpcb, u16_t len);
+typedef err_t (*tcp_poll_fn)(void *arg, struct tcp_pcb *tpcb);
+typedef void (*tcp_err_fn)(void *arg, err_t err);
+
+#define TCP_WRITE_FLAG_COPY 0x01
+#define TCP_WRITE_FLAG_MORE 0x02
+
+struct tcp_pcb {
+  ip_addr_t remote_ip;
+  u16_t remote_port;
+  u16_t snd_buf = TCP_SND_BUF;
+  u16_t snd_queuelen = 0;
+  void *callback_arg = NULL;
+  tcp_accept_fn accept = NULL;
+  tcp_recv_fn recv = NULL;
+  tcp_sent_fn sent = NULL;
+  tcp_poll_fn poll = NULL;
+  tcp_err_fn errf = NULL;
+  uint8_t written[TCP_SND_BUF];
+  u16_t written_len = 0;
+  u16_t recved = 0;
+  bool closed = false;
+  bool aborted = false;
+  // Returned by tcp_write, e.g. ERR_MEM when lwIP is out of segments
+  err_t write_err = ERR_OK;
+};
+
+#define tcp_sndbuf(pcb) ((pcb)->snd_buf)
+#define tcp_sndqueuelen(pcb) ((pcb)->snd_queuelen)
+
+static inline struct tcp_pcb* tcp_new_ip_type(u8_t type) {
+  return NULL;
+}
+
+static inline err_t tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port) {
+  return ERR_OK;
+}
+
+static inline struct tcp_pcb* tcp_listen_with_backlog(struct tcp_pcb *pcb, u8_t backlog) {
+  return pcb;
+}
+
+static inline void tcp_arg(struct tcp_pcb *pcb, void *arg) {
+  pcb->callback_arg = arg;
+}
+
+static inline void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept) {
+  pcb->accept = accept;
+}
+
+static inline void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv) {
+  pcb->recv = recv;
+}
+
+static inline void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent) {
+  pcb->sent = sent;
+}
+
+static inline void tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval) {
+  pcb->poll = poll;
+}
+
+static inline void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err) {
+  pcb->errf = err;
+}
+
+static inline void tcp_recved(struct tcp_pcb *pcb, u16_t len) {
+  pcb->recved += len;
+}
+
+static inline err_t tcp_write(struct tcp_pcb *pcb, const void *data, u16_t len, u8_t apiflags) {
+  if (pcb->write_err != ERR_OK) {
+    return pcb->write_err;
+  }
+
+  if (len > pcb->snd_buf) {
+    return ERR_MEM;
+  }
+
+  memcpy(pcb->written + pcb->written_len, data, len);
+  pcb->written_len += len;
+  pcb->snd_buf -= len;
+  return ERR_OK;
+}
+
+static inline err_t tcp_output(struct tcp_pcb *pcb) {
+  return ERR_OK;
+}
+
+static inline err_t tcp_close(struct tcp_pcb *pcb) {
+  pcb->closed = true;
+  return ERR_OK;
+}
+
+static inline void tcp_abort(struct tcp_pcb *pcb) {
+  pcb->aborted = true;
+}
+
+#endif
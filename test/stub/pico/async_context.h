@@ -0,0 +1,137 @@
+#ifndef __STUB_PICO_ASYNC_CONTEXT_H__
+#define __STUB_PICO_ASYNC_CONTEXT_H__
+
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+
+// The workers are registered in a simulated context, a test runs them with
+// stub_async_context_run, which moves the stub timer to the next at_time worker
+
+typedef struct async_context {
+  int unused;
+} async_context_t;
+
+typedef struct async_when_pending_worker {
+  struct async_when_pending_worker *next;
+  void (*do_work)(async_context_t *context, struct async_when_pending_worker *worker);
+  bool work_pending;
+  void *user_data;
+} async_when_pending_worker_t;
+
+typedef struct async_work_on_timeout {
+  struct async_work_on_timeout *next;
+  void (*do_work)(async_context_t *context, struct async_work_on_timeout *worker);
+  absolute_time_t next_time;
+  void *user_data;
+} async_at_time_worker_t;
+
+#define STUB_ASYNC_MAX_WORKERS 8
+
+inline async_when_pending_worker_t *stub_when_pending_workers[STUB_ASYNC_MAX_WORKERS];
+inline async_at_time_worker_t *stub_at_time_workers[STUB_ASYNC_MAX_WORKERS];
+
+template <typename T>
+static inline bool stub_async_add(T **workers, T *worker) {
+  for (int i = 0; i < STUB_ASYNC_MAX_WORKERS; i++) {
+    if (workers[i] == NULL || workers[i] == worker) {
+      workers[i] = worker;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+template <typename T>
+static inline bool stub_async_remove(T **workers, T *worker) {
+  for (int i = 0; i < STUB_ASYNC_MAX_WORKERS; i++) {
+    if (workers[i] == worker) {
+      workers[i] = NULL;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static inline bool async_context_add_when_pending_worker(async_context_t *context, async_when_pending_worker_t *worker) {
+  return stub_async_add(stub_when_pending_workers, worker);
+}
+
+static inline bool async_context_remove_when_pending_worker(async_context_t *context, async_when_pending_worker_t *worker) {
+  return stub_async_remove(stub_when_pending_workers, worker);
+}
+
+static inline void async_context_set_work_pending(async_context_t *context, async_when_pending_worker_t *worker) {
+  worker->work_pending = true;
+}
+
+static inline bool async_context_add_at_time_worker_in_ms(async_context_t *context, async_at_time_worker_t *worker, uint32_t ms) {
+  worker->next_time = time_us_64() + ms * 1000ull;
+  return stub_async_add(stub_at_time_workers, worker);
+}
+
+static inline bool async_context_remove_at_time_worker(async_context_t *context, async_at_time_worker_t *worker) {
+  return stub_async_remove(stub_at_time_workers, worker);
+}
+
+/**
+ * Runs the workers for `ms` of stub time, the time jumps to the next at_time
+ * worker while nothing is pending. Returns the number of wake-ups, a wake-up
+ * runs the workers until none is pending or due, like the SDK does.
+ */
+static inline uint32_t stub_async_context_run(async_context_t *context, const uint32_t &ms) {
+  const uint64_t end = time_us_64() + ms * 1000ull;
+  uint32_t wakeups = 0;
+  bool sleeping = true;
+
+  while (true) {
+    bool woken = false;
+
+    for (int i = 0; i < STUB_ASYNC_MAX_WORKERS; i++) {
+      async_when_pending_worker_t *worker = stub_when_pending_workers[i];
+      if (worker != NULL && worker->work_pending) {
+        worker->work_pending = false;
+        worker->do_work(context, worker);
+        woken = true;
+      }
+    }
+
+    uint64_t next = end;
+    for (int i = 0; i < STUB_ASYNC_MAX_WORKERS; i++) {
+      async_at_time_worker_t *worker = stub_at_time_workers[i];
+      if (worker == NULL) {
+        continue;
+      }
+
+      if (worker->next_time <= time_us_64()) {
+        stub_at_time_workers[i] = NULL;
+        worker->do_work(context, worker);
+        woken = true;
+      } else if (worker->next_time < next) {
+        next = worker->next_time;
+      }
+    }
+
+    if (woken) {
+      wakeups += sleeping;
+      sleeping = false;
+      continue;
+    }
+
+    sleeping = true;
+
+    if (time_us_64() >= end) {
+      return wakeups;
+    }
+
+    stub_time_advance_us += next - time_us_64();
+  }
+}
+
+static inline void async_context_wait_for_work_ms(async_context_t *context, uint32_t ms) { }
+
+static inline void async_context_poll(async_context_t *context) { }
+
+#endif
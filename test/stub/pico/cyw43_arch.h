@@ -0,0 +1,54 @@
+#ifndef __STUB_PICO_CYW43_ARCH_H__
+#define __STUB_PICO_CYW43_ARCH_H__
+
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "pico/async_context.h"
+#include "lwip/ip_addr.h"
+
+// A single threaded host, the lwIP lock does nothing and the link is always up
+
+#define CYW43_WL_GPIO_LED_PIN 0
+#define CYW43_ITF_STA 0
+#define CYW43_AUTH_WPA2_AES_PSK 0x00400004
+#define CYW43_COUNTRY(a, b, rev) ((unsigned)(a) | ((unsigned)(b) << 8) | ((rev) << 16))
+
+enum {
+  CYW43_LINK_DOWN = 0,
+  CYW43_LINK_JOIN = 1,
+  CYW43_LINK_NOIP = 2,
+  CYW43_LINK_UP = 3,
+  CYW43_LINK_FAIL = -1,
+  CYW43_LINK_NONET = -2,
+  CYW43_LINK_BADAUTH = -3
+};
+
+typedef struct cyw43_t_ {
+  int unused;
+} cyw43_t;
+
+inline cyw43_t cyw43_state;
+inline async_context_t cyw43_async_context;
+
+static inline async_context_t* cyw43_arch_async_context() {
+  return &cyw43_async_context;
+}
+
+static inline int cyw43_tcpip_link_status(cyw43_t *self, int itf) {
+  return CYW43_LINK_UP;
+}
+
+static inline int cyw43_arch_wifi_connect_async(const char *ssid, const char *pw, uint32_t auth) {
+  return 0;
+}
+
+static inline void cyw43_arch_gpio_put(unsigned pin, bool value) { }
+
+static inline void cyw43_arch_lwip_begin() { }
+
+static inline void cyw43_arch_lwip_end() { }
+
+static inline void cyw43_arch_lwip_check() { }
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __STUB_PICO_MULTICORE_H__
+#define __STUB_PICO_MULTICORE_H__
+
+#include <stdint.h>
+
+static inline uint32_t get_core_num() {
+  return 0;
+}
+
+#endif
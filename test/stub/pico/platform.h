@@ -0,0 +1,10 @@
+#ifndef __STUB_PICO_PLATFORM_H__
+#define __STUB_PICO_PLATFORM_H__
+
+// The host has no flash, the section attributes are dropped
+
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#define __force_inline inline __attribute__((always_inline))
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __STUB_PICO_STDLIB_H__
+#define __STUB_PICO_STDLIB_H__
+
+#include <stdint.h>
+#include <chrono>
+
+#include "pico/platform.h"
+
+// The timer of the host, time since the first call instead of since boot
+
+typedef uint64_t absolute_time_t;
+
+// Added to the timer, a test moves the time forward without waiting
+inline uint64_t stub_time_advance_us = 0;
+
+static inline uint64_t time_us_64() {
+  static const auto start = std::chrono::steady_clock::now();
+  return stub_time_advance_us + std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static inline absolute_time_t get_absolute_time() {
+  return time_us_64();
+}
+
+static inline uint32_t to_ms_since_boot(const absolute_time_t &time) {
+  return time / 1000;
+}
+
+static inline void tight_loop_contents() { }
+
+#endif
@@ -0,0 +1,42 @@
+#include "hardware/watchdog.h"
+#include <stdint.h>
+
+#include "info.cpp"
+#include "command-queue.cpp"
+
+#ifndef INCLUDE_NLOHMANN_JSON_HPP_
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+#endif
+
+#ifndef __TEST_SERVICE_CPP__
+#define __TEST_SERVICE_CPP__
+
+// The service interface used by the handler, in place of services/desk.cpp
+
+typedef struct TEST_COMMAND_T_ {
+  int value;
+} TEST_COMMAND_T;
+
+class TestService {
+  public:
+    bool is_ready() {
+      return true;
+    }
+};
+
+TestService service;
+CommandQueue<TEST_COMMAND_T> service_commands;
+static int service_submitted = 0;
+
+json service_get_data() {
+  return {};
+}
+
+uint32_t service_submit_command(const json &body) {
+  service_submitted++;
+  return service_commands.submit({ 1 });
+}
+
+#endif
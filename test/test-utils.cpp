@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <chrono>
+#include <new>
+#include <vector>
+
+#ifndef __TEST_UTILS_CPP__
+#define __TEST_UTILS_CPP__
+
+/* #region Checks */
+
+static int test_failures = 0;
+
+#define TEST_CHECK(condition) do { \
+  if (!(condition)) { \
+    printf("[Test] %s:%d failed: %s\n", __FILE__, __LINE__, #condition); \
+    test_failures++; \
+  } \
+} while (0)
+
+#define TEST_RUN(test) do { \
+  printf("[Test] %s\n", #test); \
+  test(); \
+} while (0)
+
+static int test_result() {
+  printf("[Test] %d failed checks\n", test_failures);
+  return test_failures == 0 ? 0 : 1;
+}
+
+/* #endregion */
+
+/* #region Data */
+
+static std::vector<uint8_t> test_hex(const char *hex) {
+  std::vector<uint8_t> bytes;
+
+  for (size_t i = 0; hex[i] != '\0' && hex[i + 1] != '\0'; i += 2) {
+    const char byte[3] = { hex[i], hex[i + 1], '\0' };
+    bytes.push_back((uint8_t)strtoul(byte, NULL, 16));
+  }
+
+  return bytes;
+}
+
+/* #endregion */
+
+/* #region Allocations */
+
+// Every test executable is a single translation unit, so the counters see all the allocations
+static size_t test_allocations = 0;
+static size_t test_live_allocations = 0;
+
+void* operator new(std::size_t size) {
+  test_allocations++;
+  test_live_allocations++;
+
+  void *ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == NULL) {
+    throw std::bad_alloc();
+  }
+
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  if (ptr != NULL) {
+    test_live_allocations--;
+  }
+
+  free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t size) noexcept {
+  operator delete(ptr);
+}
+
+/* #endregion */
+
+/* #region Benchmarks */
+
+// Written by the benchmarks so the measured work is not optimized out
+static volatile uint64_t bench_sink = 0;
+
+/**
+ * Runs `fn(i)` `iterations` times, returns the nanoseconds per iteration
+ */
+template <typename Fn>
+double bench_ns(const size_t &iterations, Fn fn) {
+  const auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < iterations; i++) {
+    fn(i);
+  }
+
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+/* #endregion */
+
+#endif
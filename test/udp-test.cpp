@@ -0,0 +1,170 @@
+#include <string.h>
+#include <string>
+
+#define UDP_SERVER_PORT 8099
+
+#include "./test-utils.cpp"
+#include "./test-service.cpp"
+#include "server.cpp"
+
+static TCP_SERVER_T *state = tcp_server_init();
+static struct udp_pcb pcb;
+
+static ip_addr_t test_addr(const uint8_t &last) {
+  ip_addr_t addr;
+  addr.addr = 0x0000A8C0 + (last << 24);
+  return addr;
+}
+
+/**
+ * A PING frame with a new IV
+ */
+static std::string ping_frame(const std::string &id) {
+  uint8_t buffer[TCP_SERVER_BUF_SIZE];
+  uint16_t offset = 0;
+  uint16_t len = 0;
+
+  frame_build({ {"type", "PING"}, {"id", id} }, buffer, sizeof(buffer), &offset, &len);
+  return std::string((const char*)buffer + offset, len);
+}
+
+/**
+ * Delivers the datagram, returns true if it was answered
+ */
+static bool send_datagram(const ip_addr_t &addr, const std::string &frame) {
+  struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, frame.size(), PBUF_RAM);
+  memcpy(p->payload, frame.data(), frame.size());
+
+  const int sent = udp_sent_count;
+  udp_server_recv(state, &pcb, p, &addr, 50000);
+  return udp_sent_count == sent + 1;
+}
+
+/**
+ * A frame of random data, it's valid base64 but doesn't decrypt to a packet
+ */
+static std::string junk_frame() {
+  uint8_t data[45];
+  random_fill(data, sizeof(data));
+
+  const std::string encoded = base64_encode(std::string((const char*)data, sizeof(data)));
+  return std::to_string(encoded.size()) + ";" + encoded;
+}
+
+static void test_replay() {
+  const ip_addr_t addr = test_addr(10);
+  const std::string frame = ping_frame("1");
+
+  TEST_CHECK(send_datagram(addr, frame));
+  TEST_CHECK(!send_datagram(addr, frame));
+
+  // The same request encrypted again is answered, a replay from another address is dropped
+  TEST_CHECK(send_datagram(addr, ping_frame("1")));
+  TEST_CHECK(!send_datagram(test_addr(11), frame));
+}
+
+/**
+ * Datagrams that don't decrypt to a packet don't flush the windows
+ */
+static void test_replay_junk() {
+  const ip_addr_t addr = test_addr(12);
+  const std::string frame = ping_frame("junk");
+  TEST_CHECK(send_datagram(addr, frame));
+
+  for (int i = 0; i < UDP_SERVER_REPLAY_WINDOW * UDP_SERVER_REPLAY_SOURCES * 2; i++) {
+    stub_time_advance_us += 1000 * 1000;
+    send_datagram(test_addr(i % 2 == 0 ? 12 : 13 + i % 50), junk_frame());
+  }
+
+  stub_time_advance_us += 1000 * 1000;
+  TEST_CHECK(!send_datagram(addr, frame));
+  TEST_CHECK(!send_datagram(test_addr(13), frame));
+}
+
+/**
+ * The valid packets of a source only evict its own IVs
+ */
+static void test_replay_sources() {
+  const ip_addr_t addr = test_addr(14);
+  const ip_addr_t other_addr = test_addr(15);
+  const std::string frame = ping_frame("first");
+  TEST_CHECK(send_datagram(addr, frame));
+
+  for (int i = 0; i < UDP_SERVER_REPLAY_WINDOW * 4; i++) {
+    stub_time_advance_us += 1000 * 1000;
+    TEST_CHECK(send_datagram(other_addr, ping_frame(std::to_string(i))));
+  }
+
+  TEST_CHECK(!send_datagram(other_addr, frame));
+
+  // Older than the window of its own source, the replay isn't detected
+  for (int i = 0; i < UDP_SERVER_REPLAY_WINDOW; i++) {
+    stub_time_advance_us += 1000 * 1000;
+    TEST_CHECK(send_datagram(addr, ping_frame(std::to_string(i))));
+  }
+
+  TEST_CHECK(send_datagram(addr, frame));
+}
+
+/**
+ * Every source gets UDP_SERVER_RATE_LIMIT datagrams per second
+ */
+static void test_rate_limit() {
+  const ip_addr_t addr = test_addr(20);
+  const ip_addr_t other_addr = test_addr(21);
+  int answered = 0;
+
+  stub_time_advance_us += 1000 * 1000;
+
+  for (int i = 0; i < UDP_SERVER_RATE_LIMIT * 2; i++) {
+    answered += send_datagram(addr, ping_frame(std::to_string(i)));
+  }
+
+  TEST_CHECK(answered == UDP_SERVER_RATE_LIMIT);
+
+  // Another source isn't limited
+  TEST_CHECK(send_datagram(other_addr, ping_frame("other")));
+
+  // Half a second refills half of the datagrams
+  stub_time_advance_us += 500 * 1000;
+  answered = 0;
+
+  for (int i = 0; i < UDP_SERVER_RATE_LIMIT; i++) {
+    answered += send_datagram(addr, ping_frame(std::to_string(i)));
+  }
+
+  TEST_CHECK(answered == UDP_SERVER_RATE_LIMIT / 2);
+}
+
+/**
+ * A new source takes the slot of the one heard from least recently
+ */
+static void test_rate_sources() {
+  stub_time_advance_us += 1000 * 1000;
+
+  for (uint8_t i = 0; i < UDP_SERVER_RATE_SOURCES; i++) {
+    for (int j = 0; j < UDP_SERVER_RATE_LIMIT; j++) {
+      TEST_CHECK(send_datagram(test_addr(100 + i), ping_frame(std::to_string(j))));
+    }
+
+    TEST_CHECK(!send_datagram(test_addr(100 + i), ping_frame("limited")));
+
+    // The sources are told apart by the millisecond they were heard from
+    stub_time_advance_us += 1000;
+  }
+
+  // The first source is evicted, it starts again with a full bucket
+  TEST_CHECK(send_datagram(test_addr(200), ping_frame("new")));
+  TEST_CHECK(send_datagram(test_addr(100), ping_frame("evicted")));
+  TEST_CHECK(!send_datagram(test_addr(101 + UDP_SERVER_RATE_SOURCES / 2), ping_frame("tracked")));
+}
+
+int main() {
+  TEST_RUN(test_replay);
+  TEST_RUN(test_replay_junk);
+  TEST_RUN(test_replay_sources);
+  TEST_RUN(test_rate_limit);
+  TEST_RUN(test_rate_sources);
+
+  return test_result();
+}
@@ -0,0 +1,87 @@
+#include <string.h>
+#include <string>
+
+#include "./test-utils.cpp"
+#include "./test-service.cpp"
+#include "server.cpp"
+
+static const uint32_t IDLE_MS = 60000;
+
+static LatestEventTopic<int> state_topic("state", PACKET_TYPE::GET);
+
+static TCP_SERVER_T *state = tcp_server_init();
+static struct tcp_pcb pcbs[2];
+static async_context_t *context = cyw43_arch_async_context();
+
+static void connect_clients() {
+  for (uint8_t i = 0; i < 2; i++) {
+    pcbs[i] = tcp_pcb();
+    pcbs[i].remote_ip.addr = 0x0100A8C0 + (i << 24);
+    pcbs[i].remote_port = 50000 + i;
+    TEST_CHECK(tcp_server_accept(state, &pcbs[i], ERR_OK) == ERR_OK);
+  }
+}
+
+/**
+ * With connected clients and nothing happening, core 0 is only woken up by the Wi-Fi check
+ */
+static void test_idle() {
+  connect_clients();
+  tcp_server_add_workers(state);
+
+  // The first run sends what was published before the server started
+  stub_async_context_run(context, 0);
+
+  const uint32_t wakeups = stub_async_context_run(context, IDLE_MS);
+  printf("[Test] Idle: %u wake-ups in %u s, %.2f/s\n", wakeups, IDLE_MS / 1000, wakeups * 1000.0 / IDLE_MS);
+
+  TEST_CHECK(wakeups == IDLE_MS / WIFI_CHECK_INTERVAL_MS);
+}
+
+/**
+ * A publish wakes up the event bus worker once, a second publish within the client
+ * interval is sent by the timer at the end of the interval
+ */
+static void test_publish() {
+  pcbs[0].written_len = 0;
+  pcbs[0].snd_buf = TCP_SND_BUF;
+
+  state_topic.publish(1);
+  TEST_CHECK(event_bus_worker.work_pending);
+  TEST_CHECK(stub_async_context_run(context, 0) == 1);
+  TEST_CHECK(pcbs[0].written_len > 0);
+
+  const u16_t written = pcbs[0].written_len;
+  state_topic.publish(2);
+  TEST_CHECK(stub_async_context_run(context, 0) == 1);
+  TEST_CHECK(pcbs[0].written_len == written);
+
+  // The timer fires once at the end of the interval, then the core sleeps again
+  TEST_CHECK(stub_async_context_run(context, EVENT_BUS_INTERVAL_MS) == 1);
+  TEST_CHECK(pcbs[0].written_len > written);
+  TEST_CHECK(stub_async_context_run(context, WIFI_CHECK_INTERVAL_MS - EVENT_BUS_INTERVAL_MS - 1) == 0);
+}
+
+/**
+ * The busy loop the workers replaced, every pass polled the event bus and read the clock
+ */
+static void bench_busy_loop() {
+  const uint64_t end = clock_us() + 200 * 1000;
+  uint32_t iterations = 0;
+
+  while (clock_us() < end) {
+    event_bus_dispatch(state);
+    tight_loop_contents();
+    iterations++;
+  }
+
+  printf("[Test] Busy loop on the host: %.0f iterations/s\n", iterations * 5.0);
+}
+
+int main() {
+  TEST_RUN(test_idle);
+  TEST_RUN(test_publish);
+  bench_busy_loop();
+
+  return test_result();
+}